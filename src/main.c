@@ -46,13 +46,17 @@
  * 
  * Code was developed in MPLAB X v6.20
  * MCC is used to generate code for AVR device settings:
- *  - Internal 4MHz clock (default)
+ *  - Internal 4MHz clock (default), or Internal 24MHz clock (supported)
  *  - Reset Pin (PF6) set to "Reset mode"
  *  - Global Interrupt Enabled
  *  - PA0 - PA7 GPIO defined as Outputs
  *  - PC0 - PC3, PD0 - PD7, PF0 - PF1 GPIO defined as Inputs,
  *          with Pull-ups enabled
- *  - PF0 (PS2_Clock_bm) - Input Sense Interrupt = "Sense Falling Edge"
+ *  - PF0 (PS2_Clock_bm) - Input Sense Interrupt = "Sense Falling Edge",
+ *          Output value Low (PF0 is made an Output to inhibit the keyboard)
+ *  - PC0 - PC3, PD0 - PD7 (Joysticks) - Input Sense Interrupt =
+ *          "Sense Both Edges"
+ *  - TCA0 is NOT configured in MCC (it is the Timebase, set up below)
  *     
  *  Credits: This work builds on work done by Kym Greenshields and Thomas
  *   Gutmeier. Specifically, their work identifying CreatiVision Controller
@@ -62,6 +66,43 @@
  * Change Log
  * ----------
  * v1.0  - Initial release.
+ * v1.1  - Double-pole keys switched via MT8816_SwitchPair (minimal pole skew).
+ *       - 24MHz clock supported. MT8816 Strobe timing derived from F_CPU.
+ *       - MT8816 shadow state, optional RESET pin for a fast MT8816_Reset.
+ *       - Stuck key recovery on PS/2 errors, overflow or keyboard BAT.
+ *       - Keyboard Joystick mode (Keypad / arrows), toggled by 'NUM LOCK'.
+ *       - Fixed prefix flags leaking past unmapped (e.g. E0 nn) ScanCodes.
+ *       - Input Routing table (Sources -> crosspoint masks) for all inputs.
+ *       - Route Profiles, selected by 'SCROLL LOCK' + 'F1' ... 'F4'.
+ *       - Keymap generator (tools/keymap) for the Switch / PS/2 Keymap tables.
+ *       - Input events timestamped at capture (TCA0 Timebase), and processed
+ *         in the order they happened, across Joysticks and PS/2 Keyboard.
+ *       - Main loop cooperative Scheduler (priorities, deadlines, budgets).
+ *       - Buffered ScanCodes decoded in batches, with one commit per batch.
+ *       - Shorter PS/2 ISR, optional direct PORTF vector (PS2_DIRECT_VECTOR).
+ *       - PS/2 ISR is Level 1 (high) priority, with a build time check of
+ *         its (estimated) worst case latency. MT8816 list writes are atomic
+ *         in short groups.
+ *       - Health counters (PS/2 link, queue, MT8816, Joysticks), with
+ *         optional periodic Telemetry output (TELEMETRY_USART).
+ *       - PS/2 flow control (Clock inhibit) instead of losing ScanCodes on
+ *         a full Buffer, so the Buffer is now just 32 bytes.
+ *       - Explicit PS/2 prefix states. 'PAUSE' (E1) and fake shift (E0 12 /
+ *         E0 59) sequences are swallowed (no spurious 'CNTL' or 'SHIFT').
+ *       - Optional PS/2 Clock glitch filter (CCL LUT3), with glitch counts.
+ *       - Optional Analog Joystick / Paddle (ADC) Left Joystick port mode.
+ *       - Optional SNES / NES pad Joystick port mode (either port).
+ *       - Optional Sega 3 / 6-button pad Joystick port mode (either port),
+ *         with the extra buttons routed to keys (e.g. Start = 'RET'N').
+ *       - Optional PS/2 Mouse / Trackball mode (PS2_MOUSE), as a Joystick
+ *         via a movement velocity to duty cycle modulator.
+ *       - Both Joystick ports sampled as one snapshot, and both Joysticks
+ *         committed together.
+ *       - Optional Joystick fast path (JOYSTICK_FAST_PATH), committing just
+ *         the changed Joystick crosspoints (precalculated masks) from the
+ *         Joystick ISR, guarded by main loop MT8816 ownership.
+ *       - Optional coalesced MT8816 write queue (MT8816_WRITE_QUEUE), rate
+ *         limited by a TCB2 drain interrupt.
  * 
  *    
  */
@@ -69,22 +110,403 @@
 
 #include "avr/io.h"
 #include "avr/interrupt.h"
+#include "avr/eeprom.h"
 #include "util/atomic.h"
 
+/*
+ * CPU Clock
+ * F_CPU is defined by the MCC Clock Control configuration. Both the 4MHz
+ * default and 24MHz (Oscillator Frequency = 24MHz in MCC) are supported.
+ * All timing dependent code MUST derive its constants from F_CPU!
+ */
+#ifndef F_CPU
+#error "F_CPU is not defined, please check the MCC Clock Control setup"
+#endif
+
+#if (F_CPU != 4000000UL) && (F_CPU != 24000000UL)
+#warning "Untested F_CPU, supported clocks are 4MHz and 24MHz"
+#endif
+
+/* Whole CPU cycles (rounded up) needed to cover a time in nanoseconds */
+#define CYCLES_FROM_NS(ns) ((((ns) * (F_CPU / 1000000UL)) + 999UL) / 1000UL)
+
+/*
+ * Timebase
+ * TCA0 free runs as a 16-bit tick counter, used to timestamp input events
+ * at capture (i.e. in the PS/2 and Joystick ISRs). Events from different
+ * inputs can then be processed in the order they actually happened.
+ * Prescaler is chosen from F_CPU, for a 16us (4MHz) or 10.7us (24MHz) tick.
+ * So the counter wraps every 1.05s (4MHz) or 0.70s (24MHz), which is far
+ * longer than any event should wait to be processed.
+ */
+#if F_CPU > 8000000UL
+#define TIMEBASE_CLKSEL TCA_SINGLE_CLKSEL_DIV256_gc
+#define TIMEBASE_PRESCALER 256UL
+#else
+#define TIMEBASE_CLKSEL TCA_SINGLE_CLKSEL_DIV64_gc
+#define TIMEBASE_PRESCALER 64UL
+#endif
+
+/* Timebase ticks (rounded up) needed to cover a time in microseconds */
+#define TICKS_FROM_US(us) \
+    ((((us) * (F_CPU / 1000000UL)) + TIMEBASE_PRESCALER - 1) / TIMEBASE_PRESCALER)
+
+static inline void Timebase_Initialize(void)
+{
+    TCA0.SINGLE.PER = 0xFFFF;
+    TCA0.SINGLE.CTRLA = TIMEBASE_CLKSEL | TCA_SINGLE_ENABLE_bm;
+}
+
+/*
+ * Timebase_Now returns the current Timebase tick count.
+ * NOTE: The 16-bit CNT read uses the shared TCA0 TEMP register, so it is
+ *       made atomic (an interrupting CNT read would corrupt it).
+ */
+static inline uint16_t Timebase_Now(void)
+{
+    uint16_t now;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        now = TCA0.SINGLE.CNT;
+    }
+    return now;
+}
+
+/* Timebase_Before is true if timestamp a is earlier than timestamp b */
+static inline bool Timebase_Before(uint16_t a, uint16_t b)
+{
+    return (int16_t)(a - b) < 0;
+}
+
 /*
  * PS/2 Keyboard Interrupt driven ScanCode Input Buffer
  */
-#define PS2_ScanCodeBuffer_Size 254
+#define PS2_ScanCodeBuffer_Size 32
 static volatile uint8_t PS2_ScanCodeBuffer[PS2_ScanCodeBuffer_Size];
+static volatile uint16_t PS2_ScanCodeTime[PS2_ScanCodeBuffer_Size];
 static volatile uint8_t PS2_ScanCodeBuffer_Start = 0;
 static volatile uint8_t PS2_ScanCodeBuffer_End   = 0;
 
+/*
+ * PS/2 Keyboard flow control (Clock inhibit)
+ * Rather than lose ScanCodes to a full Buffer, the keyboard is inhibited
+ * (i.e. we hold the PS/2 Clock low) once PS2_BUFFER_HIGH_WATER ScanCodes are
+ * waiting, and released again once drained below PS2_BUFFER_LOW_WATER.
+ * The keyboard holds any keys in its own buffer while inhibited, and sends
+ * them once released. So nothing is lost, and the Buffer can be small.
+ * The inhibit starts at a frame's stop bit (the keyboard is still holding
+ * the Clock low), so no frame is ever cut short, and no Clock edge is made.
+ */
+#define PS2_BUFFER_HIGH_WATER (PS2_ScanCodeBuffer_Size - 4)
+#define PS2_BUFFER_LOW_WATER  (PS2_ScanCodeBuffer_Size / 4)
+static volatile bool PS2_Inhibited = false;
+
+/*
+ * PS/2 host to device (command) transmission (PS2_MOUSE only)
+ * The PS/2 ISR sends PS2_Transmit_Frame (data, parity & stop bits, and a
+ * marker bit) a bit per Clock falling edge, while PS2_Transmitting.
+ */
+static volatile bool PS2_Transmitting = false;
+static volatile uint16_t PS2_Transmit_Frame;
+
+/*
+ * PS/2 Keyboard stuck key recovery
+ * A lost ScanCode byte (buffer overflow, parity / framing error, or a
+ * keyboard internal overrun) can drop a key release (F0) prefix, leaving a
+ * CreatiVision key On. A keyboard BAT (0xAA, i.e. reset or hot-plug) also
+ * means any keys we had On are no longer held.
+ * So these request a release of all the Keyboard's crosspoints.
+ */
+static volatile bool PS2_Recovery_Request = false;
+
+/*
+ * Health counters
+ * For spotting failing keyboards, cables (or firmware) in the field, via the
+ * debugger or Telemetry output.
+ * Counters updated by ISRs are kept as 8-bit Hot counters (a single byte
+ * increment, and no 16/32-bit carry in the ISR), and are folded into the
+ * totals by the (low priority) Health Task, long before they could wrap.
+ */
+typedef struct
+{
+    uint8_t ps2_Frames;
+    uint8_t ps2_FrameErrors;
+    uint8_t ps2_Overflows;
+    uint8_t ps2_Inhibits;
+    uint8_t joystick_Events;
+    uint8_t analog_Samples;
+    uint8_t pad_Polls;
+    uint8_t joystick_FastCommits;
+    uint8_t mt8816_Strobes;
+    uint8_t mt8816_Coalesced;
+} Health_Hot_Counters;
+
+static volatile Health_Hot_Counters Health_Hot;
+
+typedef struct
+{
+    uint32_t ps2_Frames;            /* Good PS/2 frames (ScanCode bytes) */
+    uint16_t ps2_FrameErrors;       /* Parity / framing errors, or 0x00 */
+    uint16_t ps2_Overflows;         /* ScanCode Buffer overflows (flushed) */
+    uint16_t ps2_Inhibits;          /* Keyboard inhibits (Buffer high water) */
+    uint32_t ps2_ClockEdges;        /* Raw PS/2 Clock pulses (filter only) */
+    uint32_t ps2_ClockGlitches;     /* Pulses rejected by the Clock filter */
+    uint8_t  ps2_QueueHighWater;    /* Most ScanCodes waiting in the Buffer */
+    uint16_t ps2_UnknownScanCodes;  /* ScanCodes not in the PS/2 Keymap */
+    uint16_t ps2_Recoveries;        /* Stuck key recoveries */
+    uint32_t mt8816_Writes;         /* MT8816 Switch Strobes */
+    uint32_t mt8816_Suppressed;     /* Commits needing no Strobe at all */
+    uint32_t joystick_Events;       /* Joystick change events */
+    uint16_t joystick_LatencyMax;   /* Event capture to crosspoints (ticks) */
+    uint32_t analog_Samples;        /* Analog Joystick ADC conversions */
+    uint32_t pad_Polls;             /* Serial pad polls */
+    uint32_t joystick_FastCommits;  /* Joystick events committed by the ISR */
+    uint16_t mt8816_Coalesced;      /* Queued writes dropped (undone) */
+    uint8_t  mt8816_QueueHighWater; /* Most crosspoint writes queued */
+    uint16_t scheduler_DeadlineMisses; /* Task runs later than deadline */
+    uint16_t scheduler_BudgetOverruns; /* Task runs longer than budget */
+} Health_Counters;
+
+static Health_Counters Health;
+
 /*
  * PS/2 PORTF  PIN Bit Mask (bm) Definitions
  */
 static const uint8_t PS2_Clock_bm  = PIN0_bm;
 static const uint8_t PS2_Data_bm = PIN1_bm;
 
+/*
+ * PS/2 Clock Interrupt vector (optional)
+ * By default, PS2_Interrupt is called back from the MCC generated PORTF ISR
+ * (IO_PF0_SetInterruptHandler), which adds a port flag check, an indirect
+ * call and a full call-clobbered register save to every PS/2 Clock edge.
+ * Define PS2_DIRECT_VECTOR to instead make PS2_Interrupt the PORTF vector
+ * ISR itself (minimal prologue, only the registers it uses are saved).
+ * NOTE: The MCC generated ISR(PORTF_PORT_vect) (in pins.c) MUST then be
+ *       removed, after every MCC Generate! (PF0 is the only PORTF interrupt)
+ */
+// #define PS2_DIRECT_VECTOR
+
+/*
+ * PS/2 Clock glitch filter (optional)
+ * Define PS2_CLOCK_FILTER to route the PS/2 Clock (PF0) through CCL LUT3,
+ * with its filter enabled, so Clock glitches (e.g. noise picked up on long
+ * cables) shorter than 2 - 3 CPU clocks are rejected in hardware. The PS/2
+ * ISR is then the CCL (LUT3 falling edge) interrupt, and PS2_DIRECT_VECTOR
+ * doesn't apply. Raw and filtered Clock edges are counted by TCB0 and TCB1
+ * (via the Event System), so the glitch count costs no CPU time at all.
+ * NOTE: In MCC, set PF0 Input Sense to "Interrupt disabled but input buffer
+ *       enabled" (CCL, EVSYS, TCB0 & TCB1 are set up below, not in MCC).
+ */
+// #define PS2_CLOCK_FILTER
+
+/*
+ * PS/2 Mouse / Trackball mode (optional)
+ * Define PS2_MOUSE to run a PS/2 mouse (or trackball) on the PS/2 port,
+ * instead of the keyboard, as the Left Joystick (or the Right, with
+ * MOUSE_JOYSTICK_RIGHT), along with that port's own Joystick.
+ * The mouse is put in stream mode (Enable Data Reporting), and its movement
+ * packets are turned into Joystick directions by a velocity to duty cycle
+ * modulator: each axis' direction is held On for a share of every
+ * MOUSE_SLOTS x MOUSE_SLOT_us period, MOUSE_GAIN slots per count moved
+ * (per packet, i.e. per 10ms at the default 100 packets/s), until
+ * MOUSE_HOLD_SLOTS after the last packet. So faster movement moves the
+ * Joystick for longer. The Left / Right mouse buttons are Button 1 / 2.
+ * NOTE: In MCC, set PF1 (PS/2 Data) Output value Low too (PF1 is made an
+ *       Output to send the mouse its commands).
+ */
+// #define PS2_MOUSE
+// #define MOUSE_JOYSTICK_RIGHT
+#define MOUSE_SLOT_us    1000
+#define MOUSE_SLOTS      16
+#define MOUSE_GAIN       2
+#define MOUSE_HOLD_SLOTS 30
+#define MOUSE_RETRY_ms   250
+
+/*
+ * Telemetry output (optional)
+ * Define TELEMETRY_USART to send the Health counters, as a line of text
+ * every TELEMETRY_PERIOD_ms, from the USART's TXD pin.
+ * NOTE: The 28 pin AVR DA has no spare USART pins, all are in use. So this
+ *       is for test / field diagnosis only, using USART1 TXD (PC0), which
+ *       is then NOT the Right Joystick Up input! In MCC, enable USART1
+ *       (e.g. 115200 8N1, Transmitter only), and disable the PC0 Input Sense
+ *       Interrupt. The Right Joystick Up then reads as not engaged (TXD
+ *       idles high), and the rest of the Right Joystick still works.
+ */
+// #define TELEMETRY_USART USART1
+#define TELEMETRY_PERIOD_ms 500
+
+/*
+ * Joystick port modes
+ * JOYSTICK_LEFT_MODE / JOYSTICK_RIGHT_MODE select what is plugged into the
+ * Left / Right Joystick port:
+ *  JOYSTICK_MODE_ATARI  - Atari (switch) Joystick (default).
+ *  JOYSTICK_MODE_ANALOG - Analog Joystick or Paddle, read by the ADC (below).
+ *  JOYSTICK_MODE_SNES   - SNES (or NES) serial pad, polled (below).
+ *  JOYSTICK_MODE_SEGA   - Sega Mega Drive 3 / 6-button pad, or Master
+ *                         System pad, polled (below).
+ * Whatever the mode, the port reads as the usual 0b00BBRLDU Joystick value
+ * (plus any Sega extra buttons), so it has the same crosspoint routing (and
+ * Route Profiles) as ever.
+ */
+#define JOYSTICK_MODE_ATARI  0
+#define JOYSTICK_MODE_ANALOG 1
+#define JOYSTICK_MODE_SNES   2
+#define JOYSTICK_MODE_SEGA   3
+
+#define JOYSTICK_LEFT_MODE  JOYSTICK_MODE_ATARI
+#define JOYSTICK_RIGHT_MODE JOYSTICK_MODE_ATARI
+
+/*
+ * Joystick fast path (optional)
+ * Define JOYSTICK_FAST_PATH to commit Joystick changes to the crosspoints
+ * straight from the Joystick ISR (pin change, ADC, pad poll or mouse
+ * modulator), instead of buffering them for the Joystick Task. A Joystick
+ * change then never waits for the main loop (e.g. while it is decoding a
+ * PS/2 burst), but is no longer ordered with keyboard input (see Input
+ * event ordering). While the main loop owns the MT8816 (see MT8816_Own),
+ * or events are already buffered, the ISR buffers the change as usual.
+ * The ISR commit compares only the Joysticks' own crosspoints (see
+ * Route_Commit_Joysticks), so it takes the same time however many keys are
+ * held: an estimated 30us at 24MHz (JOYSTICK_COMMIT_MAX_CYCLES, plus ISR
+ * entry), not single-digit microseconds, which the MCC pin change ISR and
+ * the 64 bit mask work of an 8 bit CPU don't leave room for.
+ */
+// #define JOYSTICK_FAST_PATH
+
+/*
+ * Analog Joystick / Paddle (JOYSTICK_MODE_ANALOG, Left port only)
+ * The X / Y potentiometer wipers are read on PD2 / PD3 (AIN2 / AIN3, i.e.
+ * the Up / Down pins, DE-9 pins 1 & 2, wired via an adapter). Button 1 & 2
+ * are still the PD6 / PD7 switches, and PD4 / PD5 are unused.
+ * Each axis becomes a digital direction (so 8-way, with both axes) once it
+ * is more than ANALOG_DEAD_ZONE + ANALOG_HYSTERESIS from centre, and is only
+ * released once back within ANALOG_DEAD_ZONE. So a stick resting near the
+ * threshold doesn't chatter. A lower voltage is Up / Left.
+ * Define ANALOG_PADDLE for a single (X axis) Paddle, turning Left / Right.
+ * NOTE: In MCC, set PD2 & PD3 Input Sense to "Digital Input Buffer
+ *       disabled", with the Pull-ups disabled (ADC0 is set up below).
+ */
+#define ANALOG_X_MUXPOS ADC_MUXPOS_AIN2_gc
+#define ANALOG_Y_MUXPOS ADC_MUXPOS_AIN3_gc
+#define ANALOG_DEAD_ZONE  48    /* 8-bit sample, from centre (128) */
+#define ANALOG_HYSTERESIS 8
+// #define ANALOG_PADDLE
+
+/*
+ * SNES / NES serial pad (JOYSTICK_MODE_SNES, either port)
+ * The pad's Latch, Clock and Data lines use the port's Up, Down and Left
+ * pins (DE-9 pins 1, 2 & 3, wired via an adapter, with the pad powered
+ * from DE-9 pin 7), i.e. PD2 - PD4 (Left port) or PC0 - PC2 (Right port).
+ * The pad is read every SNES_POLL_us (1kHz), and the D-pad, B / A (Button 1)
+ * and Y / X (Button 2) are mapped to the port's Joystick (on a NES pad,
+ * A is Button 1 and B is Button 2). SNES_CLOCK_HALF_ns is the Clock high /
+ * low time (the pad's shift register is much faster, but long cables or
+ * clone pads may need a slower Clock).
+ * NOTE: In MCC, set these pins' Input Sense to "Interrupt disabled but input
+ *       buffer enabled" (the Latch & Clock are made Outputs below), and the
+ *       rest of the port's pins are unused.
+ */
+#define SNES_POLL_us 1000
+#define SNES_CLOCK_HALF_ns 1000
+
+#define SNES_LEFT_LATCH_bm  PIN2_bm /* VPORTD */
+#define SNES_LEFT_CLOCK_bm  PIN3_bm
+#define SNES_LEFT_DATA_bm   PIN4_bm
+#define SNES_RIGHT_LATCH_bm PIN0_bm /* VPORTC */
+#define SNES_RIGHT_CLOCK_bm PIN1_bm
+#define SNES_RIGHT_DATA_bm  PIN2_bm
+
+#if (JOYSTICK_LEFT_MODE == JOYSTICK_MODE_SNES) || \
+    (JOYSTICK_RIGHT_MODE == JOYSTICK_MODE_SNES)
+#define SNES_PAD
+#endif
+
+#if JOYSTICK_RIGHT_MODE == JOYSTICK_MODE_ANALOG
+#error "JOYSTICK_MODE_ANALOG is only supported on the Left port (PORTD ADC)"
+#endif
+
+/*
+ * Sega pad (JOYSTICK_MODE_SEGA, either port)
+ * The pad's 6 data lines are the port's usual Joystick pins, but its Select
+ * line (DE-9 pin 7) is +5V on an Atari port, and its +5V is DE-9 pin 5. So
+ * an adapter must power the pad from pin 5, and wire pin 7 to a spare pin,
+ * defined as SEGA_LEFT_SELECT_VPORT / _bm (or SEGA_RIGHT_SELECT_...), e.g.
+ * the other port's Button 2 pin, if that port is unused (with that pin's
+ * Input Sense Interrupt disabled in MCC).
+ * Each poll toggles Select through the 6-button sequence (in one ISR, with
+ * SEGA_SETTLE_ns after each toggle), so all the buttons are read together:
+ *  A = Button 1, B = Button 2, and Start, C, X, Y, Z & Mode are extra
+ *  Sources, routed to crosspoints by SEGA_xxx_ROUTE (or a Route Profile).
+ * A 3-button pad reads the same, but for X, Y, Z & Mode. A Master System pad
+ * (or an Atari Joystick) has no Select, and reads as usual.
+ * A 6-button pad resets its sequence once Select has been idle for 1.5ms or
+ * so. So Select is always left idle for at least SEGA_TIMEOUT_us between
+ * polls (or a poll would start mid sequence, and read X, Y, Z & Mode as the
+ * directions), and the sequence itself is far shorter than the timeout.
+ * NOTE: In MCC, set the port's pins' Input Sense to "Interrupt disabled but
+ *       input buffer enabled" (the Select pin is made an Output below).
+ */
+// #define SEGA_LEFT_SELECT_VPORT  VPORTD
+// #define SEGA_LEFT_SELECT_bm     PIN1_bm
+// #define SEGA_RIGHT_SELECT_VPORT VPORTD
+// #define SEGA_RIGHT_SELECT_bm    PIN7_bm
+#define SEGA_POLL_us    4000
+#define SEGA_TIMEOUT_us 2000    /* 1.5ms, plus a margin for clone pads */
+#define SEGA_SETTLE_ns  2000
+
+#define SEGA_START_ROUTE (XP(Switch_RETN_a) | XP(Switch_RETN_b))
+#define SEGA_C_ROUTE     (XP(Switch_SPACE_a) | XP(Switch_SPACE_b))
+#define SEGA_X_ROUTE     0
+#define SEGA_Y_ROUTE     0
+#define SEGA_Z_ROUTE     0
+#define SEGA_MODE_ROUTE  0
+
+#if (JOYSTICK_LEFT_MODE == JOYSTICK_MODE_SEGA) || \
+    (JOYSTICK_RIGHT_MODE == JOYSTICK_MODE_SEGA)
+#define SEGA_PAD
+#endif
+
+#if (JOYSTICK_LEFT_MODE == JOYSTICK_MODE_SEGA) && !defined(SEGA_LEFT_SELECT_VPORT)
+#error "JOYSTICK_MODE_SEGA (Left) needs a Select pin, SEGA_LEFT_SELECT_VPORT / _bm"
+#endif
+
+#if (JOYSTICK_RIGHT_MODE == JOYSTICK_MODE_SEGA) && !defined(SEGA_RIGHT_SELECT_VPORT)
+#error "JOYSTICK_MODE_SEGA (Right) needs a Select pin, SEGA_RIGHT_SELECT_VPORT / _bm"
+#endif
+
+#if defined(TELEMETRY_USART) && (JOYSTICK_RIGHT_MODE != JOYSTICK_MODE_ATARI)
+#error "TELEMETRY_USART TXD (PC0) is needed by the Right port pad"
+#endif
+
+/*
+ * Joystick value, 0b00BBRLDU (Up, Down, Left, Right, Button 1 & 2), and with
+ * a Sega pad, 0bMZYXCSBBRLDU (Start, C, X, Y, Z & Mode extra buttons).
+ */
+#ifdef SEGA_PAD
+typedef uint16_t Joystick_Value;
+#else
+typedef uint8_t Joystick_Value;
+#endif
+
+/*
+ * Joystick Interrupt driven (pin change) Input Event Buffer
+ * Each event is a timestamped snapshot of both Joysticks.
+ */
+typedef struct
+{
+    uint16_t time;
+    Joystick_Value joyLeft;
+    Joystick_Value joyRight;
+} Joystick_Event;
+
+#define Joystick_EventBuffer_Size 16
+static volatile Joystick_Event Joystick_EventBuffer[Joystick_EventBuffer_Size];
+static volatile uint8_t Joystick_EventBuffer_Start = 0;
+static volatile uint8_t Joystick_EventBuffer_End   = 0;
+
 /*
  * MT8816 PORTA PIN Bit Mask (bm) Definitions
  * 
@@ -96,6 +518,69 @@ static const uint8_t PS2_Data_bm = PIN1_bm;
 static const uint8_t MT_Strobe_bm = PIN6_bm;
 static const uint8_t MT_Data_bm   = PIN7_bm;
 
+/*
+ * MT8816 Control Timing (datasheet AC Electrical Characteristics, VDD = 5V)
+ * 
+ * MT8816_TIMING_MARGIN_ns covers port output slew and PCB routing. Please
+ * increase this if the MT8816 is run at a lower VDD.
+ * 
+ * Each port write is already one CPU cycle long, so only the remaining
+ * cycles (if any) are inserted as delays. At 4MHz (250ns per cycle) no
+ * delay is needed, at 24MHz (41.7ns per cycle) one extra cycle is inserted
+ * for the Strobe pulse width and Data setup.
+ */
+#define MT8816_tAS_ns  10   /* Address setup to Strobe */
+#define MT8816_tAH_ns  10   /* Address hold after Strobe */
+#define MT8816_tDS_ns  20   /* Data setup to Strobe */
+#define MT8816_tDH_ns  10   /* Data hold after Strobe */
+#define MT8816_tSPW_ns 20   /* Strobe pulse width */
+#define MT8816_tRPW_ns 40   /* Reset pulse width */
+#define MT8816_TIMING_MARGIN_ns 25
+
+#define MT8816_DELAY_CYCLES(ns) \
+    ((CYCLES_FROM_NS((ns) + MT8816_TIMING_MARGIN_ns) > 1) ? \
+     (CYCLES_FROM_NS((ns) + MT8816_TIMING_MARGIN_ns) - 1) : 0)
+
+#define MT8816_SETUP_CYCLES  MT8816_DELAY_CYCLES( \
+    (MT8816_tDS_ns > MT8816_tAS_ns) ? MT8816_tDS_ns : MT8816_tAS_ns)
+#define MT8816_STROBE_CYCLES MT8816_DELAY_CYCLES(MT8816_tSPW_ns)
+#define MT8816_HOLD_CYCLES   MT8816_DELAY_CYCLES( \
+    (MT8816_tDH_ns > MT8816_tAH_ns) ? MT8816_tDH_ns : MT8816_tAH_ns)
+#define MT8816_RESET_CYCLES  MT8816_DELAY_CYCLES(MT8816_tRPW_ns)
+
+/*
+ * MT8816 RESET input (optional)
+ * The MT8816 RESET input is normally driven by the board's hardware reset.
+ * Where it is instead wired to a spare AVR pin (configured in MCC as an
+ * Output, initially low), define the pin here, and MT8816_Reset will
+ * then pulse RESET to clear all switches in one step.
+ * Otherwise, the software clear fallback is used.
+ */
+// #define MT8816_RESET_VPORT VPORTx
+// #define MT8816_RESET_bm    PINn_bm
+
+/*
+ * MT8816 write queue (optional)
+ * Define MT8816_WRITE_QUEUE to have Route_Commit (i.e. every producer:
+ * keyboard, Joysticks, Profiles) just post its crosspoint changes to a
+ * queue, at a small constant cost per change, and never wait on the bus.
+ * The queue is coalesced per crosspoint (a change undone before it is
+ * written is simply dropped), and is drained by a TCB2 interrupt, at most
+ * MT8816_DRAIN_STROBES Strobes every MT8816_DRAIN_us. So MT8816 bus activity
+ * is rate limited, and a change waits at most MT8816_DRAIN_us (an idle
+ * queue is drained straight away).
+ */
+// #define MT8816_WRITE_QUEUE
+#define MT8816_DRAIN_us      100
+#define MT8816_DRAIN_STROBES 8
+
+/*
+ * MT8816_DELAY inserts a (compile time constant) calibrated delay.
+ * Zero cycle delays compile to nothing.
+ */
+#define MT8816_DELAY(cycles) \
+    do { if (cycles) __builtin_avr_delay_cycles(cycles); } while (0)
+
 /*
  * MT8816 AY0-2 / AX0-3 Address Input definitions for CreatiVision Controllers
  * 
@@ -216,274 +701,281 @@ static const uint8_t MT_Data_bm   = PIN7_bm;
 /*
  * Individual Key Switch address constants are declared below, using
  * the above port defines (for clarity / maximum readability)!
+ * These are #defines (not const variables), so they can also be used in
+ * the constant Input Routing tables.
+ * NOTE: Generated from tools/keymap/creativision_keys.csv, edit that file
+ *       and re-run tools/keymap/keymap_gen.py (don't edit these by hand).
  */
+/* BEGIN GENERATED SWITCHES (tools/keymap/keymap_gen.py) */
 /*
  * CreatiVision Left Controller Keyboard (24 keys)
  */
 
 /* Key 1 = Pin 2 -> Pin 6 + Pin 5 (PIA_PA0 -> PIA_PB3 + PIA_PB2) */
-static const uint8_t Switch_1_a = PIA_PA0 | PIA_PB3;
-static const uint8_t Switch_1_b = PIA_PA0 | PIA_PB2;
+#define Switch_1_a (PIA_PA0 | PIA_PB3)
+#define Switch_1_b (PIA_PA0 | PIA_PB2)
 
 /* Key 2 = Pin 1 -> Pin 10 + Pin 7 (PIA_PA1 -> PIA_PB5 + PIA_PB4) */
-static const uint8_t Switch_2_a = PIA_PA1 | PIA_PB5;
-static const uint8_t Switch_2_b = PIA_PA1 | PIA_PB4;
+#define Switch_2_a (PIA_PA1 | PIA_PB5)
+#define Switch_2_b (PIA_PA1 | PIA_PB4)
 
 /* Key 3 = Pin 1 -> Pin 10 + Pin 9 (PIA_PA1 -> PIA_PB5 + PIA_PB6) */
-static const uint8_t Switch_3_a = PIA_PA1 | PIA_PB5;
-static const uint8_t Switch_3_b = PIA_PA1 | PIA_PB6;
+#define Switch_3_a (PIA_PA1 | PIA_PB5)
+#define Switch_3_b (PIA_PA1 | PIA_PB6)
 
 /* Key 4 = Pin 1 -> Pin 10 + Pin 6 (PIA_PA1 -> PIA_PB5 + PIA_PB3) */
-static const uint8_t Switch_4_a = PIA_PA1 | PIA_PB5;
-static const uint8_t Switch_4_b = PIA_PA1 | PIA_PB3;
+#define Switch_4_a (PIA_PA1 | PIA_PB5)
+#define Switch_4_b (PIA_PA1 | PIA_PB3)
 
 /* Key 5 = Pin 1 -> Pin 9 + Pin 6 (PIA_PA1 -> PIA_PB6 + PIA_PB3) */
-static const uint8_t Switch_5_a = PIA_PA1 | PIA_PB6;
-static const uint8_t Switch_5_b = PIA_PA1 | PIA_PB3;
+#define Switch_5_a (PIA_PA1 | PIA_PB6)
+#define Switch_5_b (PIA_PA1 | PIA_PB3)
 
 /* Key 6 = Pin 1 -> Pin 9 + Pin 7 (PIA_PA1 -> PIA_PB6 + PIA_PB4) */
-static const uint8_t Switch_6_a = PIA_PA1 | PIA_PB6;
-static const uint8_t Switch_6_b = PIA_PA1 | PIA_PB4;
+#define Switch_6_a (PIA_PA1 | PIA_PB6)
+#define Switch_6_b (PIA_PA1 | PIA_PB4)
 
 /* Key CNT'L = Pin 2 -> Pin 8 (PIA_PA0 -> PIA_PB7) */
-static const uint8_t Switch_CNTL = PIA_PA0 | PIA_PB7;
+#define Switch_CNTL (PIA_PA0 | PIA_PB7)
 
 /* Key Q = Pin 1 -> Pin 7 + Pin 6 (PIA_PA1 -> PIA_PB4 + PIA_PB3) */
-static const uint8_t Switch_Q_a = PIA_PA1 | PIA_PB4;
-static const uint8_t Switch_Q_b = PIA_PA1 | PIA_PB3;
+#define Switch_Q_a (PIA_PA1 | PIA_PB4)
+#define Switch_Q_b (PIA_PA1 | PIA_PB3)
 
 /* Key W = Pin 1 -> Pin 6 + Pin 5 (PIA_PA1 -> PIA_PB3 + PIA_PB2) */
-static const uint8_t Switch_W_a = PIA_PA1 | PIA_PB3;
-static const uint8_t Switch_W_b = PIA_PA1 | PIA_PB2;
+#define Switch_W_a (PIA_PA1 | PIA_PB3)
+#define Switch_W_b (PIA_PA1 | PIA_PB2)
 
 /* Key E = Pin 1 -> Pin 7 + Pin 5 (PIA_PA1 -> PIA_PB4 + PIA_PB2) */
-static const uint8_t Switch_E_a = PIA_PA1 | PIA_PB4;
-static const uint8_t Switch_E_b = PIA_PA1 | PIA_PB2;
+#define Switch_E_a (PIA_PA1 | PIA_PB4)
+#define Switch_E_b (PIA_PA1 | PIA_PB2)
 
 /* Key R = Pin 1 -> Pin 10 + Pin 5 (PIA_PA1 -> PIA_PB5 + PIA_PB2) */
-static const uint8_t Switch_R_a = PIA_PA1 | PIA_PB5;
-static const uint8_t Switch_R_b = PIA_PA1 | PIA_PB2;
+#define Switch_R_a (PIA_PA1 | PIA_PB5)
+#define Switch_R_b (PIA_PA1 | PIA_PB2)
 
 /* Key T = Pin 1 -> Pin 9 + Pin 5 (PIA_PA1 -> PIA_PB6 + PIA_PB2) */
-static const uint8_t Switch_T_a = PIA_PA1 | PIA_PB6;
-static const uint8_t Switch_T_b = PIA_PA1 | PIA_PB2;
+#define Switch_T_a (PIA_PA1 | PIA_PB6)
+#define Switch_T_b (PIA_PA1 | PIA_PB2)
 
 /* Key LEFT ARROW = Pin 1 -> Pin 6 + Pin 3 (PIA_PA1 -> PIA_PB3 + PIA_PB0) */
-static const uint8_t Switch_LEFT_a = PIA_PA1 | PIA_PB3;
-static const uint8_t Switch_LEFT_b = PIA_PA1 | PIA_PB0;
+#define Switch_LEFT_a (PIA_PA1 | PIA_PB3)
+#define Switch_LEFT_b (PIA_PA1 | PIA_PB0)
 
 /* Key A = Pin 1 -> Pin 7 + Pin 3 (PIA_PA1 -> PIA_PB4 + PIA_PB0) */
-static const uint8_t Switch_A_a = PIA_PA1 | PIA_PB4;
-static const uint8_t Switch_A_b = PIA_PA1 | PIA_PB0;
+#define Switch_A_a (PIA_PA1 | PIA_PB4)
+#define Switch_A_b (PIA_PA1 | PIA_PB0)
 
 /* Key S = Pin 1 -> Pin 10 + Pin 3 (PIA_PA1 -> PIA_PB5 + PIA_PB0) */
-static const uint8_t Switch_S_a = PIA_PA1 | PIA_PB5;
-static const uint8_t Switch_S_b = PIA_PA1 | PIA_PB0;
+#define Switch_S_a (PIA_PA1 | PIA_PB5)
+#define Switch_S_b (PIA_PA1 | PIA_PB0)
 
 /* Key D = Pin 1 -> Pin 9 + Pin 3 (PIA_PA1 -> PIA_PB6 + PIA_PB0) */
-static const uint8_t Switch_D_a = PIA_PA1 | PIA_PB6;
-static const uint8_t Switch_D_b = PIA_PA1 | PIA_PB0;
+#define Switch_D_a (PIA_PA1 | PIA_PB6)
+#define Switch_D_b (PIA_PA1 | PIA_PB0)
 
 /* Key F = Pin 1 -> Pin 4 + Pin 3 (PIA_PA1 -> PIA_PB1 + PIA_PB0) */
-static const uint8_t Switch_F_a = PIA_PA1 | PIA_PB1;
-static const uint8_t Switch_F_b = PIA_PA1 | PIA_PB0;
+#define Switch_F_a (PIA_PA1 | PIA_PB1)
+#define Switch_F_b (PIA_PA1 | PIA_PB0)
 
 /* Key G = Pin 1 -> Pin 5 + Pin 3 (PIA_PA1 -> PIA_PB2 + PIA_PB0) */
-static const uint8_t Switch_G_a = PIA_PA1 | PIA_PB2;
-static const uint8_t Switch_G_b = PIA_PA1 | PIA_PB0;
+#define Switch_G_a (PIA_PA1 | PIA_PB2)
+#define Switch_G_b (PIA_PA1 | PIA_PB0)
 
 /* Key SHIFT = Pin 1 -> Pin 8 (PIA_PA1 -> PIA_PB7) */
-static const uint8_t Switch_SHIFT = PIA_PA1 | PIA_PB7;
+#define Switch_SHIFT (PIA_PA1 | PIA_PB7)
 
 /* Key Z = Pin 1 -> Pin 6 + Pin 4 (PIA_PA1 -> PIA_PB3 + PIA_PB1) */
-static const uint8_t Switch_Z_a = PIA_PA1 | PIA_PB3;
-static const uint8_t Switch_Z_b = PIA_PA1 | PIA_PB1;
+#define Switch_Z_a (PIA_PA1 | PIA_PB3)
+#define Switch_Z_b (PIA_PA1 | PIA_PB1)
 
 /* Key X = Pin 1 -> Pin 7 + Pin 4 (PIA_PA1 -> PIA_PB4 + PIA_PB1) */
-static const uint8_t Switch_X_a = PIA_PA1 | PIA_PB4;
-static const uint8_t Switch_X_b = PIA_PA1 | PIA_PB1;
+#define Switch_X_a (PIA_PA1 | PIA_PB4)
+#define Switch_X_b (PIA_PA1 | PIA_PB1)
 
 /* Key C = Pin 1 -> Pin 10 + Pin 4 (PIA_PA1 -> PIA_PB5 + PIA_PB1) */
-static const uint8_t Switch_C_a = PIA_PA1 | PIA_PB5;
-static const uint8_t Switch_C_b = PIA_PA1 | PIA_PB1;
+#define Switch_C_a (PIA_PA1 | PIA_PB5)
+#define Switch_C_b (PIA_PA1 | PIA_PB1)
 
 /* Key V = Pin 1 -> Pin 9 + Pin 4 (PIA_PA1 -> PIA_PB6 + PIA_PB1) */
-static const uint8_t Switch_V_a = PIA_PA1 | PIA_PB6;
-static const uint8_t Switch_V_b = PIA_PA1 | PIA_PB1;
+#define Switch_V_a (PIA_PA1 | PIA_PB6)
+#define Switch_V_b (PIA_PA1 | PIA_PB1)
 
 /* Key B = Pin 1 -> Pin 5 + Pin 4 (PIA_PA1 -> PIA_PB2 + PIA_PB1) */
-static const uint8_t Switch_B_a = PIA_PA1 | PIA_PB2;
-static const uint8_t Switch_B_b = PIA_PA1 | PIA_PB1;
+#define Switch_B_a (PIA_PA1 | PIA_PB2)
+#define Switch_B_b (PIA_PA1 | PIA_PB1)
 
 /*
  * CreatiVision Right Controller Keyboard (24 keys)
  */
 
 /* Key 7 = Pin 9 -> Pin 2 + Pin 1 (PIA_PA3 -> PIA_PB1 + PIA_PB2) */
-static const uint8_t Switch_7_a = PIA_PA3 | PIA_PB1;
-static const uint8_t Switch_7_b = PIA_PA3 | PIA_PB2;
+#define Switch_7_a (PIA_PA3 | PIA_PB1)
+#define Switch_7_b (PIA_PA3 | PIA_PB2)
 
 /* Key 8 = Pin 9 -> Pin 7 + Pin 2 (PIA_PA3 -> PIA_PB6 + PIA_PB1) */
-static const uint8_t Switch_8_a = PIA_PA3 | PIA_PB6;
-static const uint8_t Switch_8_b = PIA_PA3 | PIA_PB1;
+#define Switch_8_a (PIA_PA3 | PIA_PB6)
+#define Switch_8_b (PIA_PA3 | PIA_PB1)
 
 /* Key 9 = Pin 9 -> Pin 6 + Pin 2 (PIA_PA3 -> PIA_PB5 + PIA_PB1) */
-static const uint8_t Switch_9_a = PIA_PA3 | PIA_PB5;
-static const uint8_t Switch_9_b = PIA_PA3 | PIA_PB1;
+#define Switch_9_a (PIA_PA3 | PIA_PB5)
+#define Switch_9_b (PIA_PA3 | PIA_PB1)
 
 /* Key 0 = Pin 9 -> Pin 5 + Pin 2 (PIA_PA3 -> PIA_PB4 + PIA_PB1) */
-static const uint8_t Switch_0_a = PIA_PA3 | PIA_PB4;
-static const uint8_t Switch_0_b = PIA_PA3 | PIA_PB1;
+#define Switch_0_a (PIA_PA3 | PIA_PB4)
+#define Switch_0_b (PIA_PA3 | PIA_PB1)
 
 /* Key : = Pin 9 -> Pin 4 + Pin 2 (PIA_PA3 -> PIA_PB3 + PIA_PB1) */
-static const uint8_t Switch_COLON_a = PIA_PA3 | PIA_PB3;
-static const uint8_t Switch_COLON_b = PIA_PA3 | PIA_PB1;
+#define Switch_COLON_a (PIA_PA3 | PIA_PB3)
+#define Switch_COLON_b (PIA_PA3 | PIA_PB1)
 
 /* Key - = Pin 9 -> Pin 8 (PIA_PA3 -> PIA_PB7) */
-static const uint8_t Switch_MINUS = PIA_PA3 | PIA_PB7;
+#define Switch_MINUS (PIA_PA3 | PIA_PB7)
 
 /* Key Y = Pin 9 -> Pin 3 + Pin 1 (PIA_PA3 -> PIA_PB0 + PIA_PB2) */
-static const uint8_t Switch_Y_a = PIA_PA3 | PIA_PB0;
-static const uint8_t Switch_Y_b = PIA_PA3 | PIA_PB2;
+#define Switch_Y_a (PIA_PA3 | PIA_PB0)
+#define Switch_Y_b (PIA_PA3 | PIA_PB2)
 
 /* Key U = Pin 9 -> Pin 3 + Pin 2 (PIA_PA3 -> PIA_PB0 + PIA_PB1) */
-static const uint8_t Switch_U_a = PIA_PA3 | PIA_PB0;
-static const uint8_t Switch_U_b = PIA_PA3 | PIA_PB1;
+#define Switch_U_a (PIA_PA3 | PIA_PB0)
+#define Switch_U_b (PIA_PA3 | PIA_PB1)
 
 /* Key I = Pin 9 -> Pin 7 + Pin 3 (PIA_PA3 -> PIA_PB6 + PIA_PB0) */
-static const uint8_t Switch_I_a = PIA_PA3 | PIA_PB6;
-static const uint8_t Switch_I_b = PIA_PA3 | PIA_PB0;
+#define Switch_I_a (PIA_PA3 | PIA_PB6)
+#define Switch_I_b (PIA_PA3 | PIA_PB0)
 
 /* Key O = Pin 9 -> Pin 6 + Pin 3 (PIA_PA3 -> PIA_PB5 + PIA_PB0) */
-static const uint8_t Switch_O_a = PIA_PA3 | PIA_PB5;
-static const uint8_t Switch_O_b = PIA_PA3 | PIA_PB0;
+#define Switch_O_a (PIA_PA3 | PIA_PB5)
+#define Switch_O_b (PIA_PA3 | PIA_PB0)
 
 /* Key P = Pin 9 -> Pin 5 + Pin 3 (PIA_PA3 -> PIA_PB4 + PIA_PB0) */
-static const uint8_t Switch_P_a = PIA_PA3 | PIA_PB4;
-static const uint8_t Switch_P_b = PIA_PA3 | PIA_PB0;
+#define Switch_P_a (PIA_PA3 | PIA_PB4)
+#define Switch_P_b (PIA_PA3 | PIA_PB0)
 
 /* Key RET'N = Pin 9 -> Pin 4 + Pin 3 (PIA_PA3 -> PIA_PB3 + PIA_PB0) */
-static const uint8_t Switch_RETN_a = PIA_PA3 | PIA_PB3;
-static const uint8_t Switch_RETN_b = PIA_PA3 | PIA_PB0;
+#define Switch_RETN_a (PIA_PA3 | PIA_PB3)
+#define Switch_RETN_b (PIA_PA3 | PIA_PB0)
 
 /* Key H = Pin 9 -> Pin 7 + Pin 1 (PIA_PA3 -> PIA_PB6 + PIA_PB2) */
-static const uint8_t Switch_H_a = PIA_PA3 | PIA_PB6;
-static const uint8_t Switch_H_b = PIA_PA3 | PIA_PB2;
+#define Switch_H_a (PIA_PA3 | PIA_PB6)
+#define Switch_H_b (PIA_PA3 | PIA_PB2)
 
 /* Key J = Pin 9 -> Pin 6 + Pin 1 (PIA_PA3 -> PIA_PB5 + PIA_PB2) */
-static const uint8_t Switch_J_a = PIA_PA3 | PIA_PB5;
-static const uint8_t Switch_J_b = PIA_PA3 | PIA_PB2;
+#define Switch_J_a (PIA_PA3 | PIA_PB5)
+#define Switch_J_b (PIA_PA3 | PIA_PB2)
 
 /* Key K = Pin 9 -> Pin 5 + Pin 1 (PIA_PA3 -> PIA_PB4 + PIA_PB2) */
-static const uint8_t Switch_K_a = PIA_PA3 | PIA_PB4;
-static const uint8_t Switch_K_b = PIA_PA3 | PIA_PB2;
+#define Switch_K_a (PIA_PA3 | PIA_PB4)
+#define Switch_K_b (PIA_PA3 | PIA_PB2)
 
 /* Key L = Pin 9 -> Pin 4 + Pin 1 (PIA_PA3 -> PIA_PB3 + PIA_PB2) */
-static const uint8_t Switch_L_a = PIA_PA3 | PIA_PB3;
-static const uint8_t Switch_L_b = PIA_PA3 | PIA_PB2;
+#define Switch_L_a (PIA_PA3 | PIA_PB3)
+#define Switch_L_b (PIA_PA3 | PIA_PB2)
 
 /* Key ; = Pin 9 -> Pin 5 + Pin 4 (PIA_PA3 -> PIA_PB4 + PIA_PB3) */
-static const uint8_t Switch_SEMICOLON_a = PIA_PA3 | PIA_PB4;
-static const uint8_t Switch_SEMICOLON_b = PIA_PA3 | PIA_PB3;
+#define Switch_SEMICOLON_a (PIA_PA3 | PIA_PB4)
+#define Switch_SEMICOLON_b (PIA_PA3 | PIA_PB3)
 
 /* Key N = Pin 9 -> Pin 7 + Pin 5 (PIA_PA3 -> PIA_PB6 + PIA_PB4) */
-static const uint8_t Switch_N_a = PIA_PA3 | PIA_PB6;
-static const uint8_t Switch_N_b = PIA_PA3 | PIA_PB4;
+#define Switch_N_a (PIA_PA3 | PIA_PB6)
+#define Switch_N_b (PIA_PA3 | PIA_PB4)
 
 /* Key M = Pin 9 -> Pin 7 + Pin 4 (PIA_PA3 -> PIA_PB6 + PIA_PB3) */
-static const uint8_t Switch_M_a = PIA_PA3 | PIA_PB6;
-static const uint8_t Switch_M_b = PIA_PA3 | PIA_PB3;
+#define Switch_M_a (PIA_PA3 | PIA_PB6)
+#define Switch_M_b (PIA_PA3 | PIA_PB3)
 
 /* Key , = Pin 9 -> Pin 6 + Pin 4 (PIA_PA3 -> PIA_PB5 + PIA_PB3) */
-static const uint8_t Switch_COMMA_a = PIA_PA3 | PIA_PB5;
-static const uint8_t Switch_COMMA_b = PIA_PA3 | PIA_PB3;
+#define Switch_COMMA_a (PIA_PA3 | PIA_PB5)
+#define Switch_COMMA_b (PIA_PA3 | PIA_PB3)
 
 /* Key . = Pin 9 -> Pin 7 + Pin 6 (PIA_PA3 -> PIA_PB6 + PIA_PB5) */
-static const uint8_t Switch_PERIOD_a = PIA_PA3 | PIA_PB6;
-static const uint8_t Switch_PERIOD_b = PIA_PA3 | PIA_PB5;
+#define Switch_PERIOD_a (PIA_PA3 | PIA_PB6)
+#define Switch_PERIOD_b (PIA_PA3 | PIA_PB5)
 
 /* Key / = Pin 9 -> Pin 6 + Pin 5 (PIA_PA3 -> PIA_PB5 + PIA_PB4) */
-static const uint8_t Switch_FORWARDSLASH_a = PIA_PA3 | PIA_PB5;
-static const uint8_t Switch_FORWARDSLASH_b = PIA_PA3 | PIA_PB4;
+#define Switch_FORWARDSLASH_a (PIA_PA3 | PIA_PB5)
+#define Switch_FORWARDSLASH_b (PIA_PA3 | PIA_PB4)
 
 /* Key RIGHT ARROW = Pin 10 -> Pin 8 (PIA_PA2 -> PIA_PB7) */
-static const uint8_t Switch_RIGHT = PIA_PA2 | PIA_PB7;
+#define Switch_RIGHT (PIA_PA2 | PIA_PB7)
 
 /* Key SPACE = Pin 10 -> Pin 4 + Pin 1 (PIA_PA2 -> PIA_PB3 + PIA_PB2) */
-static const uint8_t Switch_SPACE_a = PIA_PA2 | PIA_PB3;
-static const uint8_t Switch_SPACE_b = PIA_PA2 | PIA_PB2;
+#define Switch_SPACE_a (PIA_PA2 | PIA_PB3)
+#define Switch_SPACE_b (PIA_PA2 | PIA_PB2)
 
 /*
  * CreatiVision Left Controller Joystick
  */
 
 /* Up = Pin 2 -> Pin 6 (PIA_PA0 -> PIA_PB3) */
-static const uint8_t Switch_JoyL_Up = PIA_PA0 | PIA_PB3;
+#define Switch_JoyL_Up (PIA_PA0 | PIA_PB3)
 
 /* Down = Pin 2 -> Pin 4 (PIA_PA0 -> PIA_PB1) */
-static const uint8_t Switch_JoyL_Down = PIA_PA0 | PIA_PB1;
+#define Switch_JoyL_Down (PIA_PA0 | PIA_PB1)
 
-/* Left = Pin 2 + Pin 10 (PIA_PA0 -> PIA_PB5) */
-static const uint8_t Switch_JoyL_Left = PIA_PA0 | PIA_PB5;
+/* Left = Pin 2 -> Pin 10 (PIA_PA0 -> PIA_PB5) */
+#define Switch_JoyL_Left (PIA_PA0 | PIA_PB5)
 
 /* Right = Pin 2 -> Pin 5 (PIA_PA0 -> PIA_PB2) */
-static const uint8_t Switch_JoyL_Right = PIA_PA0 | PIA_PB2;
+#define Switch_JoyL_Right (PIA_PA0 | PIA_PB2)
 
 /* Up Left Extra = Pin 2 -> Pin 7 (PIA_PA0 -> PIA_PB4) */
-static const uint8_t Switch_JoyL_UpLeft_Extra = PIA_PA0 | PIA_PB4;
+#define Switch_JoyL_UpLeft_Extra (PIA_PA0 | PIA_PB4)
 
 /* Up Right & Down Left Extra = Pin 2 -> Pin 9 (PIA_PA0 -> PIA_PB6) */
-static const uint8_t Switch_JoyL_UpRightDownLeft_Extra = PIA_PA0 | PIA_PB6;
+#define Switch_JoyL_UpRightDownLeft_Extra (PIA_PA0 | PIA_PB6)
 
 /* Down Right Extra = Pin 2 -> Pin 3 (PIA_PA0 -> PIA_PB0) */
-static const uint8_t Switch_JoyL_DownRight_Extra = PIA_PA0 | PIA_PB0;
+#define Switch_JoyL_DownRight_Extra (PIA_PA0 | PIA_PB0)
 
 /* Button 1 = Pin 2 -> Pin 8 (PIA_PA0 -> PIA_PB7) */
-static const uint8_t Switch_JoyL_Button1 = PIA_PA0 | PIA_PB7;
+#define Switch_JoyL_Button1 (PIA_PA0 | PIA_PB7)
 
 /* Button 2 = Pin 1 -> Pin 8 (PIA_PA1 -> PIA_PB7) */
-static const uint8_t Switch_JoyL_Button2 = PIA_PA1 | PIA_PB7;
+#define Switch_JoyL_Button2 (PIA_PA1 | PIA_PB7)
 
-/**
+/*
  * CreatiVision Right Controller Joystick
  */
 
 /* Up = Pin 10 -> Pin 4 (PIA_PA2 -> PIA_PB3) */
-static const uint8_t Switch_JoyR_Up = PIA_PA2 | PIA_PB3;
+#define Switch_JoyR_Up (PIA_PA2 | PIA_PB3)
 
 /* Down = Pin 10 -> Pin 2 (PIA_PA2 -> PIA_PB1) */
-static const uint8_t Switch_JoyR_Down = PIA_PA2 | PIA_PB1;
+#define Switch_JoyR_Down (PIA_PA2 | PIA_PB1)
 
 /* Left = Pin 10 -> Pin 6 (PIA_PA2 -> PIA_PB5) */
-static const uint8_t Switch_JoyR_Left = PIA_PA2 | PIA_PB5;
+#define Switch_JoyR_Left (PIA_PA2 | PIA_PB5)
 
-/* Right = Pin 10 -> + Pin 1 (PIA_PA2 -> PIA_PB2) */
-static const uint8_t Switch_JoyR_Right = PIA_PA2 | PIA_PB2;
+/* Right = Pin 10 -> Pin 1 (PIA_PA2 -> PIA_PB2) */
+#define Switch_JoyR_Right (PIA_PA2 | PIA_PB2)
 
 /* Up Left Extra = Pin 10 -> Pin 5 (PIA_PA2 -> PIA_PB4) */
-static const uint8_t Switch_JoyR_UpLeft_Extra = PIA_PA2 | PIA_PB4;
+#define Switch_JoyR_UpLeft_Extra (PIA_PA2 | PIA_PB4)
 
 /* Up Right & Down Left Extra = Pin 10 -> Pin 7 (PIA_PA2 -> PIA_PB6) */
-static const uint8_t Switch_JoyR_UpRightDownLeft_Extra = PIA_PA2 | PIA_PB6;
+#define Switch_JoyR_UpRightDownLeft_Extra (PIA_PA2 | PIA_PB6)
 
 /* Down Right Extra = Pin 10 -> Pin 3 (PIA_PA2 -> PIA_PB0) */
-static const uint8_t Switch_JoyR_DownRight_Extra = PIA_PA2 | PIA_PB0;
+#define Switch_JoyR_DownRight_Extra (PIA_PA2 | PIA_PB0)
 
-/** Button 1 = Pin 10 -> Pin 8 (PIA_PA2 -> PIA_PB7) */
-static const uint8_t Switch_JoyR_Button1 = PIA_PA2 | PIA_PB7;
+/* Button 1 = Pin 10 -> Pin 8 (PIA_PA2 -> PIA_PB7) */
+#define Switch_JoyR_Button1 (PIA_PA2 | PIA_PB7)
 
-/** Button 2 - Pin 9 + Pin 8 (PIA_PA3 -> PIA_PB7) */
-static const uint8_t Switch_JoyR_Button2 = PIA_PA3 | PIA_PB7;
+/* Button 2 = Pin 9 -> Pin 8 (PIA_PA3 -> PIA_PB7) */
+#define Switch_JoyR_Button2 (PIA_PA3 | PIA_PB7)
+
+/* END GENERATED SWITCHES */
 
 /**
- * MT8816_Switch turns the Addressed Switch ON or OFF (switchState true/false)
+ * MT8816_PortValue returns the PORTA value which addresses the given Switch.
  * NOTE: We also address here (in software) the MT8816 illogical truth table!
  *       Specifically, please note the datasheet Address Decode Truth Table:
  *       "* Switch connections are not in ascending order"  
  *       Yep, FFS! What idiot created this Truth Table design? 
  *       So, the switch statement below returns us to logical X0 - X15 mapping.
  */
-static void MT8816_Switch(bool switchState, uint8_t switchAddress)
+static inline uint8_t MT8816_PortValue(uint8_t switchAddress)
 {
     uint8_t switchAddressX = switchAddress & 0x0F;
     uint8_t switchAddressY = switchAddress & 0x30;
@@ -496,861 +988,3285 @@ static void MT8816_Switch(bool switchState, uint8_t switchAddress)
              switchAddressX -= 6;
             break;
     }
-    PORTA.OUT = (switchAddressX | switchAddressY);
-    
+    return (switchAddressX | switchAddressY);
+}
+
+/*
+ * MT8816 Switch shadow state
+ * One bit per crosspoint, indexed by the 00YYXXXX Switch address
+ * (i.e. byte = address bits YYX, bit = address bits XXX).
+ * Kept in step with every MT8816 write, so the driver always knows which
+ * switches are On (without reading back the MT8816, which isn't possible).
+ */
+#define MT8816_CROSSPOINTS 64
+static uint8_t MT8816_Shadow[MT8816_CROSSPOINTS / 8];
+
+/*
+ * MT8816 ownership (JOYSTICK_FAST_PATH only)
+ * The main loop owns the MT8816 (and the Route state) while it routes or
+ * commits, by MT8816_Own / MT8816_Release (nestable, a count). The Joystick
+ * ISR only commits while the count is 0, i.e. never in the middle of a main
+ * loop Strobe sequence, or with the Route state half updated. Main loop
+ * code is preempted by the ISR, so its own count update (a read, modify,
+ * write) is safe, as the ISR always leaves the count as it found it.
+ * The shared state (MT8816_Shadow, Route_Active, Health, ...) isn't
+ * volatile, so a compiler memory barrier (COMPILER_BARRIER) keeps all of
+ * its accesses inside the owned section, after the count goes up, and
+ * before it comes down again.
+ */
+#define COMPILER_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+#ifdef JOYSTICK_FAST_PATH
+static volatile uint8_t MT8816_Owned = 0;
+
+#define MT8816_Own()     do { MT8816_Owned++; COMPILER_BARRIER(); } while (0)
+#define MT8816_Release() do { COMPILER_BARRIER(); MT8816_Owned--; } while (0)
+#else
+#define MT8816_Own()
+#define MT8816_Release()
+#endif
+
+static const uint8_t Crosspoint_bm[8] = 
+    { PIN0_bm, PIN1_bm, PIN2_bm, PIN3_bm, PIN4_bm, PIN5_bm, PIN6_bm, PIN7_bm };
+
+/*
+ * Crosspoint_Update / Crosspoint_Test set, clear or test the bit for a
+ * Switch address, in a crosspoint mask (as per the shadow state layout).
+ */
+static inline void Crosspoint_Update(uint8_t *mask, bool switchState, 
+                                     uint8_t switchAddress)
+{
+    uint8_t index = switchAddress & 0x3F;
+
     if (switchState == true)
-        PORTA.OUTSET = MT_Data_bm;
+        mask[index >> 3] |= Crosspoint_bm[index & 0x07];
     else
-        PORTA.OUTCLR = MT_Data_bm;
-        
-    PORTA.OUTSET = MT_Strobe_bm;
-    /* We could just clear the strobe pin but I like to return the port to 0 */
-//    PORTA.OUTCLR = MT_Strobe_bm;
-    PORTA.OUT = 0;
+        mask[index >> 3] &= ~Crosspoint_bm[index & 0x07];
 }
 
-/**
- * MT8816_Reset resets all used Switches to the OFF state
- * NOTE: This should be entirely unnecessary if an appropriate
- *       hardware reset of the MT8816 is in place!
- *       But, to accommodate a software only reset option (no hardware reset),
- *       this is retained. With a hardware reset in place this then becomes
- *       just a "to be sure" reset. Why not? ;)
- */
-static inline void MT8816_Reset(void)
+static inline bool Crosspoint_Test(const uint8_t *mask, uint8_t switchAddress)
 {
-    for(uint8_t lp1 = 0; lp1 < 4; lp1++ )
-        for(uint8_t lp2 = 0; lp2 < 16; lp2++ )
-            MT8816_Switch(false, (lp1<<4) | lp2);
+    uint8_t index = switchAddress & 0x3F;
+
+    return (mask[index >> 3] & Crosspoint_bm[index & 0x07]) != 0;
 }
 
 /**
- *  Left Joystick uses PORTD PIN2 - PIN7
- *  PORTD definitions:
- *  PIN2 = Up
- *  PIN3 = Down
- *  PIN4 = Left
- *  PIN5 = Right
- *  PIN6 = Button 1
- *  PIN7 = Button 2
- *
- * Read Left Joystick
- * Returns 0 if no Joystick actions are engaged (all switches are off)
- * else 0b00BBRLDU
- * Specifically:
- *  Up           = 0b00xxxxxU
- *  Down         = 0b00xxxxDx
- *  Left         = 0b00xxxLxx
- *  Right        = 0b00xxRxxx
- *  Button 1     = 0b00xBxxxx
- *  Button 2     = 0b00Bxxxxx  
+ * MT8816_Strobe latches a single (already decoded) PORTA address & data value.
+ * NOTE: Address and Data are presented together, and held through the
+ *       Strobe falling edge (address / data hold), before the port returns
+ *       to 0. VPORTA is used so each step is a single cycle OUT instruction.
  */
-static inline uint8_t readJoystick_Left(void)
+static inline void MT8816_Strobe(uint8_t portValue)
 {
-    uint8_t joyValD;
-    
-    joyValD = ~(PORTD.IN) & 0xFC;
-    
-    joyValD = joyValD >> 2;
-    return joyValD;
+    VPORTA.OUT = portValue;
+    MT8816_DELAY(MT8816_SETUP_CYCLES);
+    VPORTA.OUT = portValue | MT_Strobe_bm;
+    MT8816_DELAY(MT8816_STROBE_CYCLES);
+    VPORTA.OUT = portValue;
+    MT8816_DELAY(MT8816_HOLD_CYCLES);
+    /* We could just clear the strobe pin but I like to return the port to 0 */
+    VPORTA.OUT = 0;
 }
 
+/*
+ * Interrupts are held off for at most MT8816_ATOMIC_STROBES back-to-back
+ * Strobes at a time, which bounds the PS/2 ISR latency.
+ */
+#define MT8816_ATOMIC_STROBES 4
+
+#ifndef MT8816_WRITE_QUEUE
 /**
- *  Right Joystick uses PORTC PIN0 - PIN3 and PORTD PIN0 - PIN1
- *  PORTC definitions:
- *  PIN0 = Up
- *  PIN1 = Down
- *  PIN2 = Left
- *  PIN3 = Right
- * 
- *  PORTD definitions:
- *  PIN0 = Button 1
- *  PIN1 = Button 2
- *
- * Read Right Joystick
- * Returns 0 if no Joystick actions are engaged (all switches are off)
- * else 0b00BBRLDU
- * Specifically:
- *  Up           = 0b00xxxxxU
- *  Down         = 0b00xxxxDx
- *  Left         = 0b00xxxLxx
- *  Right        = 0b00xxRxxx
- *  Button 1     = 0b00xBxxxx
- *  Button 2     = 0b00Bxxxxx  
+ * MT8816_Switch turns the Addressed Switch ON or OFF (switchState true/false)
  */
-static inline uint8_t readJoystick_Right(void)
+static void MT8816_Switch(bool switchState, uint8_t switchAddress)
 {
-    uint8_t joyValC;
-    uint8_t joyValD;
+    uint8_t portValue = MT8816_PortValue(switchAddress);
 
-    joyValC = ~(PORTC.IN) & 0x0F;
-    joyValD = ~(PORTD.IN) & 0x03;
-    
-    joyValD = joyValD << 4;
-    return joyValC | joyValD;
+    if (switchState == true)
+        portValue |= MT_Data_bm;
+
+    MT8816_Strobe(portValue);
+    Crosspoint_Update(MT8816_Shadow, switchState, switchAddress);
+    Health.mt8816_Writes++;
 }
 
-/*
- * process_Joystick_Left reads the current Left Joystick input and if changed,
- *  switches On or Off the required switches to facilitate 8-way Joystick 
- *  switch input for the CreatiVision.
- *  Note that we switch Off any switches that might have been previously On,
- *  before turning On any currently detected On switches!
+/**
+ * MT8816_SwitchPair turns both poles of a double-pole key ON or OFF
+ * (switchState true/false), with the smallest achievable pole skew.
+ * 
+ * The MT8816 can only latch one crosspoint per Strobe, so the console can
+ * always sample some skew between the two poles. To minimise it, both port
+ * values are calculated before the first Strobe, and the two Strobe
+ * sequences are then written back-to-back with interrupts held off (so the
+ * PS/2 ISR can't land between the poles):
+ * 
+ *   OUT a        (address / data a setup)
+ *   OUT a|STB    <- pole a latched
+ *   OUT a        (address / data a hold)
+ *   OUT b        (address / data b setup)
+ *   OUT b|STB    <- pole b latched
+ *   OUT b        (address / data b hold)
+ * 
+ * Pole skew (Strobe a rising to Strobe b rising) is therefore 3 single
+ * cycle OUT instructions, plus any F_CPU calibrated Strobe / hold / setup
+ * delays = MT8816_PAIR_SKEW_CYCLES CPU cycles (3 = 750ns at 4MHz,
+ * 5 = 208ns at 24MHz), versus a full MT8816_Switch call overhead previously.
+ * Release uses the same sequence, so a half-open key is just as brief.
  */
-static inline void process_Joystick_Left(void)
-{
-    static uint8_t joyLeft_prev = 0;
+#define MT8816_PAIR_SKEW_CYCLES \
+    (3 + MT8816_STROBE_CYCLES + MT8816_HOLD_CYCLES + MT8816_SETUP_CYCLES)
 
-    uint8_t joyLeft = readJoystick_Left();
+static void MT8816_SwitchPair(bool switchState, uint8_t switchAddress_a, 
+                              uint8_t switchAddress_b)
+{
+    uint8_t portValue_a = MT8816_PortValue(switchAddress_a);
+    uint8_t portValue_b = MT8816_PortValue(switchAddress_b);
 
-    if (joyLeft != joyLeft_prev)
+    if (switchState == true)
     {
-        if (joyLeft & 0x10) 
-        {
-            MT8816_Switch(true, Switch_JoyL_Button1);
-        } else 
-        {
-            MT8816_Switch(false, Switch_JoyL_Button1);
-        }   
+        portValue_a |= MT_Data_bm;
+        portValue_b |= MT_Data_bm;
+    }
 
-        if (joyLeft & 0x20) 
-        {
-            MT8816_Switch(true, Switch_JoyL_Button2);
-        } else 
-        {
-            MT8816_Switch(false, Switch_JoyL_Button2);
-        }   
+    uint8_t strobeValue_a = portValue_a | MT_Strobe_bm;
+    uint8_t strobeValue_b = portValue_b | MT_Strobe_bm;
 
-        switch(joyLeft & 0x0F)
-        {
-            case 0x01: /* Up */
-                MT8816_Switch(false, Switch_JoyL_Down);
-                MT8816_Switch(false, Switch_JoyL_Left);
-                MT8816_Switch(false, Switch_JoyL_Right);
-                MT8816_Switch(false, Switch_JoyL_UpLeft_Extra);
-                MT8816_Switch(false, Switch_JoyL_UpRightDownLeft_Extra);
-                MT8816_Switch(false, Switch_JoyL_DownRight_Extra);
-                MT8816_Switch(true, Switch_JoyL_Up);
-                break;
-
-            case 0x02: /* Down */
-                MT8816_Switch(false, Switch_JoyL_Up);
-                MT8816_Switch(false, Switch_JoyL_Left);
-                MT8816_Switch(false, Switch_JoyL_Right);
-                MT8816_Switch(false, Switch_JoyL_UpLeft_Extra);
-                MT8816_Switch(false, Switch_JoyL_UpRightDownLeft_Extra);
-                MT8816_Switch(false, Switch_JoyL_DownRight_Extra);
-                MT8816_Switch(true, Switch_JoyL_Down);
-                break;
-
-            case 0x04: /* Left */
-                MT8816_Switch(false, Switch_JoyL_Up);
-                MT8816_Switch(false, Switch_JoyL_Down);
-                MT8816_Switch(false, Switch_JoyL_Right);
-                MT8816_Switch(false, Switch_JoyL_UpLeft_Extra);
-                MT8816_Switch(false, Switch_JoyL_UpRightDownLeft_Extra);
-                MT8816_Switch(false, Switch_JoyL_DownRight_Extra);
-                MT8816_Switch(true, Switch_JoyL_Left);
-                break;
-
-            case 0x08: /* Right */
-                MT8816_Switch(false, Switch_JoyL_Up);
-                MT8816_Switch(false, Switch_JoyL_Down);
-                MT8816_Switch(false, Switch_JoyL_Left);
-                MT8816_Switch(false, Switch_JoyL_UpLeft_Extra);
-                MT8816_Switch(false, Switch_JoyL_UpRightDownLeft_Extra);
-                MT8816_Switch(false, Switch_JoyL_DownRight_Extra);
-                MT8816_Switch(true, Switch_JoyL_Right);
-                break;
-
-            case 0x05: /* Up Left */
-                MT8816_Switch(false, Switch_JoyL_Down);
-                MT8816_Switch(false, Switch_JoyL_Right);
-                MT8816_Switch(false, Switch_JoyL_UpRightDownLeft_Extra);
-                MT8816_Switch(false, Switch_JoyL_DownRight_Extra);
-                MT8816_Switch(true, Switch_JoyL_UpLeft_Extra);
-                MT8816_Switch(true, Switch_JoyL_Up);
-                MT8816_Switch(true, Switch_JoyL_Left);
-                break;
-
-            case 0x09: /* Up Right */
-                MT8816_Switch(false, Switch_JoyL_Down);
-                MT8816_Switch(false, Switch_JoyL_Left);
-                MT8816_Switch(false, Switch_JoyL_UpLeft_Extra);
-                MT8816_Switch(false, Switch_JoyL_DownRight_Extra);
-                MT8816_Switch(true, Switch_JoyL_UpRightDownLeft_Extra);
-                MT8816_Switch(true, Switch_JoyL_Up);
-                MT8816_Switch(true, Switch_JoyL_Right);
-                break;
-
-            case 0x0A: /* Down Right */
-                MT8816_Switch(false, Switch_JoyL_Up);
-                MT8816_Switch(false, Switch_JoyL_Left);
-                MT8816_Switch(false, Switch_JoyL_UpLeft_Extra);
-                MT8816_Switch(false, Switch_JoyL_UpRightDownLeft_Extra);
-                MT8816_Switch(true, Switch_JoyL_DownRight_Extra);
-                MT8816_Switch(true, Switch_JoyL_Down);
-                MT8816_Switch(true, Switch_JoyL_Right);
-                break;
-
-            case 0x06: /* Down Left */ 
-                MT8816_Switch(false, Switch_JoyL_Up);
-                MT8816_Switch(false, Switch_JoyL_Right);
-                MT8816_Switch(false, Switch_JoyL_UpLeft_Extra);
-                MT8816_Switch(false, Switch_JoyL_DownRight_Extra);
-                MT8816_Switch(true, Switch_JoyL_UpRightDownLeft_Extra);
-                MT8816_Switch(true, Switch_JoyL_Down);
-                MT8816_Switch(true, Switch_JoyL_Left);
-                break;
-
-            default: /* No Joystick Switches are On! */ 
-                MT8816_Switch(false, Switch_JoyL_Up);
-                MT8816_Switch(false, Switch_JoyL_Down);
-                MT8816_Switch(false, Switch_JoyL_Left);
-                MT8816_Switch(false, Switch_JoyL_Right);
-                MT8816_Switch(false, Switch_JoyL_UpLeft_Extra);
-                MT8816_Switch(false, Switch_JoyL_UpRightDownLeft_Extra);
-                MT8816_Switch(false, Switch_JoyL_DownRight_Extra);
-                break;
-        }        
-        
-        joyLeft_prev = joyLeft;
-    }        
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        VPORTA.OUT = portValue_a;
+        MT8816_DELAY(MT8816_SETUP_CYCLES);
+        VPORTA.OUT = strobeValue_a;
+        MT8816_DELAY(MT8816_STROBE_CYCLES);
+        VPORTA.OUT = portValue_a;
+        MT8816_DELAY(MT8816_HOLD_CYCLES);
+        VPORTA.OUT = portValue_b;
+        MT8816_DELAY(MT8816_SETUP_CYCLES);
+        VPORTA.OUT = strobeValue_b;
+        MT8816_DELAY(MT8816_STROBE_CYCLES);
+        VPORTA.OUT = portValue_b;
+        MT8816_DELAY(MT8816_HOLD_CYCLES);
+    }
+    VPORTA.OUT = 0;
+
+    Crosspoint_Update(MT8816_Shadow, switchState, switchAddress_a);
+    Crosspoint_Update(MT8816_Shadow, switchState, switchAddress_b);
+    Health.mt8816_Writes += 2;
 }
 
-/*
- * process_Joystick_Right reads the current Right Joystick input and if changed,
- *  switches On or Off the required switches to facilitate 8-way Joystick 
- *  switch input for the CreatiVision.
- *  Note that we switch Off any switches that might have been previously On,
- *  before turning On any currently detected On switches!
+/**
+ * MT8816_SwitchList turns a list of Switches ON or OFF (switchState true/false)
+ * Two Switches are written as a pair (minimal pole skew). Otherwise, all
+ * port values are calculated first, and then written back-to-back with
+ * interrupts held off (adding only the loop overhead between Strobes).
+ * Interrupts are held off for at most MT8816_ATOMIC_STROBES Strobes at a
+ * time, which bounds the PS/2 ISR latency however long the list is.
+ * NOTE: switchAddresses is overwritten with the calculated port values!
  */
-static inline void process_Joystick_Right(void)
+static void MT8816_SwitchList(bool switchState, uint8_t *switchAddresses, 
+                              uint8_t count)
 {
-    static uint8_t joyRight_prev = 0;
-
-    uint8_t joyRight = readJoystick_Right();
+    if (count == 1)
+    {
+        MT8816_Switch(switchState, switchAddresses[0]);
+        return;
+    }
+    if (count == 2)
+    {
+        MT8816_SwitchPair(switchState, switchAddresses[0], switchAddresses[1]);
+        return;
+    }
 
-    if (joyRight != joyRight_prev)
+    for(uint8_t lp = 0; lp < count; lp++ )
     {
-        if (joyRight & 0x10) 
-        {
-            MT8816_Switch(true, Switch_JoyR_Button1);
-        } else 
-        {
-            MT8816_Switch(false, Switch_JoyR_Button1);
-        }   
+        Crosspoint_Update(MT8816_Shadow, switchState, switchAddresses[lp]);
+        switchAddresses[lp] = MT8816_PortValue(switchAddresses[lp]) 
+                              | (switchState ? MT_Data_bm : 0);
+    }
 
-        if (joyRight & 0x20) 
-        {
-            MT8816_Switch(true, Switch_JoyR_Button2);
-        } else 
-        {
-            MT8816_Switch(false, Switch_JoyR_Button2);
-        }   
+    uint8_t lp = 0;
+
+    Health.mt8816_Writes += count;
 
-        switch(joyRight & 0x0F)
+    while (lp < count)
+    {
+        uint8_t strobes = 0;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
         {
-            case 0x01: /* Up */
-                MT8816_Switch(false, Switch_JoyR_Down);
-                MT8816_Switch(false, Switch_JoyR_Left);
-                MT8816_Switch(false, Switch_JoyR_Right);
-                MT8816_Switch(false, Switch_JoyR_UpLeft_Extra);
-                MT8816_Switch(false, Switch_JoyR_UpRightDownLeft_Extra);
-                MT8816_Switch(false, Switch_JoyR_DownRight_Extra);
-                MT8816_Switch(true, Switch_JoyR_Up);
-                break;
-
-            case 0x02: /* Down */
-                MT8816_Switch(false, Switch_JoyR_Up);
-                MT8816_Switch(false, Switch_JoyR_Left);
-                MT8816_Switch(false, Switch_JoyR_Right);
-                MT8816_Switch(false, Switch_JoyR_UpLeft_Extra);
-                MT8816_Switch(false, Switch_JoyR_UpRightDownLeft_Extra);
-                MT8816_Switch(false, Switch_JoyR_DownRight_Extra);
-                MT8816_Switch(true, Switch_JoyR_Down);
-                break;
-
-            case 0x04: /* Left */
-                MT8816_Switch(false, Switch_JoyR_Up);
-                MT8816_Switch(false, Switch_JoyR_Down);
-                MT8816_Switch(false, Switch_JoyR_Right);
-                MT8816_Switch(false, Switch_JoyR_UpLeft_Extra);
-                MT8816_Switch(false, Switch_JoyR_UpRightDownLeft_Extra);
-                MT8816_Switch(false, Switch_JoyR_DownRight_Extra);
-                MT8816_Switch(true, Switch_JoyR_Left);
-                break;
-
-            case 0x08: /* Right */
-                MT8816_Switch(false, Switch_JoyR_Up);
-                MT8816_Switch(false, Switch_JoyR_Down);
-                MT8816_Switch(false, Switch_JoyR_Left);
-                MT8816_Switch(false, Switch_JoyR_UpLeft_Extra);
-                MT8816_Switch(false, Switch_JoyR_UpRightDownLeft_Extra);
-                MT8816_Switch(false, Switch_JoyR_DownRight_Extra);
-                MT8816_Switch(true, Switch_JoyR_Right);
-                break;
-
-            case 0x05: /* Up Left */  
-                MT8816_Switch(false, Switch_JoyR_Down);
-                MT8816_Switch(false, Switch_JoyR_Right);
-                MT8816_Switch(false, Switch_JoyR_UpRightDownLeft_Extra);
-                MT8816_Switch(false, Switch_JoyR_DownRight_Extra);
-                MT8816_Switch(true, Switch_JoyR_UpLeft_Extra);
-                MT8816_Switch(true, Switch_JoyR_Up);
-                MT8816_Switch(true, Switch_JoyR_Left);
-                break;
-
-            case 0x09: /* Up Right */ 
-                MT8816_Switch(false, Switch_JoyR_Down);
-                MT8816_Switch(false, Switch_JoyR_Left);
-                MT8816_Switch(false, Switch_JoyR_UpLeft_Extra);
-                MT8816_Switch(false, Switch_JoyR_DownRight_Extra);
-                MT8816_Switch(true, Switch_JoyR_UpRightDownLeft_Extra);
-                MT8816_Switch(true, Switch_JoyR_Up);
-                MT8816_Switch(true, Switch_JoyR_Right);
-                break;
-
-            case 0x0A: /* Down Right */ 
-                MT8816_Switch(false, Switch_JoyR_Up);
-                MT8816_Switch(false, Switch_JoyR_Left);
-                MT8816_Switch(false, Switch_JoyR_UpLeft_Extra);
-                MT8816_Switch(false, Switch_JoyR_UpRightDownLeft_Extra);
-                MT8816_Switch(true, Switch_JoyR_DownRight_Extra);
-                MT8816_Switch(true, Switch_JoyR_Down);
-                MT8816_Switch(true, Switch_JoyR_Right);
-                break;
-
-            case 0x06: /* Down Left */ 
-                MT8816_Switch(false, Switch_JoyR_Up);
-                MT8816_Switch(false, Switch_JoyR_Right);
-                MT8816_Switch(false, Switch_JoyR_UpLeft_Extra);
-                MT8816_Switch(false, Switch_JoyR_DownRight_Extra);
-                MT8816_Switch(true, Switch_JoyR_UpRightDownLeft_Extra);
-                MT8816_Switch(true, Switch_JoyR_Down);
-                MT8816_Switch(true, Switch_JoyR_Left);
-                break;
-
-            default: /* No Joystick Switches are On! */ 
-                MT8816_Switch(false, Switch_JoyR_Up);
-                MT8816_Switch(false, Switch_JoyR_Down);
-                MT8816_Switch(false, Switch_JoyR_Left);
-                MT8816_Switch(false, Switch_JoyR_Right);
-                MT8816_Switch(false, Switch_JoyR_UpLeft_Extra);
-                MT8816_Switch(false, Switch_JoyR_UpRightDownLeft_Extra);
-                MT8816_Switch(false, Switch_JoyR_DownRight_Extra);
-                break;
-        }        
-
-        joyRight_prev = joyRight;
+            do
+                MT8816_Strobe(switchAddresses[lp++]);
+            while ((lp < count) && (++strobes < MT8816_ATOMIC_STROBES));
+        }
     }
 }
+#endif
 
-
-/* 
- * get_PS2_ScanCode gets a Scan Code byte from the PS2_ScanCodeBuffer
- * Returns 0 if Buffer is empty
- * Atomic block is defined to ensure no interrupt occurs (buffer change),
- * while we are extracting a ScanCode from the buffer!
+#ifdef MT8816_WRITE_QUEUE
+/*
+ * MT8816 write queue (see MT8816_WRITE_QUEUE)
+ * With the queue, MT8816_Shadow is the state the MT8816 is being switched
+ * to, and MT8816_Queued marks the crosspoints still to be written (i.e.
+ * the MT8816 itself is MT8816_Shadow ^ MT8816_Queued). So posting a change
+ * is just two bit flips, and a change posted while the opposite change is
+ * still queued cancels it (coalesced). MT8816_QueueDepth counts the
+ * crosspoints queued.
+ * The drain (TCB2 periodic interrupt) is only enabled while anything is
+ * queued. TCB2 keeps counting while it is disabled, so its interrupt flag
+ * is then already set, and the first drain comes straight away.
  */
-static inline uint8_t get_PS2_ScanCode(void)
-{
-	uint8_t value;
+#define MT8816_DRAIN_CYCLES (MT8816_DRAIN_us * (F_CPU / 1000000UL))
 
-	ATOMIC_BLOCK(ATOMIC_FORCEON) 
-    {
-		if (PS2_ScanCodeBuffer_Start == PS2_ScanCodeBuffer_End)
-			return 0;
+#if MT8816_DRAIN_CYCLES > 0x10000
+#error "MT8816_DRAIN_us is too long for TCB2"
+#endif
 
-		value = PS2_ScanCodeBuffer[PS2_ScanCodeBuffer_Start];
-        
-		if (++PS2_ScanCodeBuffer_Start == PS2_ScanCodeBuffer_Size)
-			PS2_ScanCodeBuffer_Start = 0;
-	}
-	return value;
+static uint8_t MT8816_Queued[MT8816_CROSSPOINTS / 8];
+static uint8_t MT8816_QueueDepth = 0;
+
+static void MT8816_Queue_Initialize(void)
+{
+    TCB2.CCMP = MT8816_DRAIN_CYCLES - 1;
+    TCB2.CTRLB = TCB_CNTMODE_INT_gc;
+    TCB2.CTRLA = TCB_CLKSEL_DIV1_gc | TCB_ENABLE_bm;
 }
 
 /*
- * process_PS2_ScanCode turns On or Off CreatiVision switches based on
- * appropriate scanCode(s) being returned.
+ * MT8816_Drain_Hold / MT8816_Drain_Start hold off the drain while changes
+ * are posted (so a commit's changes are drained together), and then start
+ * it, if anything is queued. The queue state (MT8816_Queued, the shadow,
+ * ...) isn't volatile, so a compiler memory barrier (COMPILER_BARRIER, as
+ * for MT8816_Own) keeps all of its accesses between the two.
  */
-static void process_PS2_ScanCode(void)
+static inline void MT8816_Drain_Hold(void)
+{
+    TCB2.INTCTRL = 0;
+    COMPILER_BARRIER();
+}
+
+static inline void MT8816_Drain_Start(void)
 {
-	static uint8_t key_release = 0;
-	static uint8_t extended = 0;
+    COMPILER_BARRIER();
+    if (MT8816_QueueDepth)
+        TCB2.INTCTRL = TCB_CAPT_bm;
+}
 
 /*
- * Initialize Switch values a & b to No Action!
+ * MT8816_Post queues a Switch change (switchState true/false), which MUST
+ * differ from the shadow state (as Route_Commit's changes do). The drain
+ * MUST be held off.
  */
-    uint8_t switchValue_a = NO_SWITCH_ACTION;
-    uint8_t switchValue_b = NO_SWITCH_ACTION;
+static inline void MT8816_Post(bool switchState, uint8_t switchAddress)
+{
+    uint8_t index = switchAddress & 0x3F;
+    uint8_t bm = Crosspoint_bm[index & 0x07];
 
-    uint8_t scanCode = get_PS2_ScanCode();
+    Crosspoint_Update(MT8816_Shadow, switchState, index);
+    MT8816_Queued[index >> 3] ^= bm;
 
-    if (scanCode) {
-    
-/*
- * Process all ScanCodes that are of interest to us
- */
-        switch (scanCode)
-        {
-/*
- * First check for special action ScanCodes and cache as appropriate flags
- */
-            case 0xF0: /* Key release */
-                key_release = 1;
-                break;
+    if (MT8816_Queued[index >> 3] & bm)
+    {
+        if (++MT8816_QueueDepth > Health.mt8816_QueueHighWater)
+            Health.mt8816_QueueHighWater = MT8816_QueueDepth;
+    }
+    else
+    {
+        MT8816_QueueDepth--;
+        Health_Hot.mt8816_Coalesced++;
+    }
+}
 
-            case 0xE0: /* Extended ScanCode */
-            case 0xE1: /* Additional Extended ScanCode */     
-                extended = 1;
-                break;
 /*
- * Then check ScanCodes of interest for the Left Controller Keyboard (24 keys)
+ * MT8816_Drain_List adds up to (MT8816_DRAIN_STROBES - count) queued
+ * crosspoints, being switched to switchState, to the port value list.
+ * Returns the new count.
  */
-            case 0x16 : /* '1' key */
-                switchValue_a = Switch_1_a;
-                switchValue_b = Switch_1_b;
-                break;
+static uint8_t MT8816_Drain_List(bool switchState, uint8_t *portValues, 
+                                 uint8_t count)
+{
+    for(uint8_t lp1 = 0; lp1 < sizeof(MT8816_Queued); lp1++ )
+    {
+        uint8_t queued = MT8816_Queued[lp1];
 
-            case 0x69 :
-                if (extended == 0)
-                { /* Keypad '1' key */
-                    switchValue_a = Switch_1_a;
-                    switchValue_b = Switch_1_b;
-                }
-                break;
-
-            case 0x1E : /* '2' key */
-                switchValue_a = Switch_2_a;
-                switchValue_b = Switch_2_b;
-                break;
-
-            case 0x72 :
-                if (extended == 0)
-                { /* Keypad '2' key */
-                    switchValue_a = Switch_2_a;
-                    switchValue_b = Switch_2_b;
-                }
-                break;
-
-            case 0x26 : /* '3' key */
-                switchValue_a = Switch_3_a;
-                switchValue_b = Switch_3_b;
-                break;
-
-            case 0x7A :
-                if (extended == 0)
-                { /* Keypad '3' key */
-                    switchValue_a = Switch_3_a;
-                    switchValue_b = Switch_3_b;
-                }
-                break;
-
-            case 0x25 : /* '4' key */
-                switchValue_a = Switch_4_a;
-                switchValue_b = Switch_4_b;
-                break;
-
-            case 0x2E : /* '5' key */
-                switchValue_a = Switch_5_a;
-                switchValue_b = Switch_5_b;
-                break;
-
-            case 0x73 : /* Keypad '5' key */
-                switchValue_a = Switch_5_a;
-                switchValue_b = Switch_5_b;
-                break;
-
-            case 0x36 : /* '6' key */
-                switchValue_a = Switch_6_a;
-                switchValue_b = Switch_6_b;
-                break;
-
-            case 0x15 : /* 'Q' key */
-                switchValue_a = Switch_Q_a;
-                switchValue_b = Switch_Q_b;
-                break;
-
-            case 0x1D : /* 'W' key */
-                switchValue_a = Switch_W_a;
-                switchValue_b = Switch_W_b;
-                break;
-
-            case 0x24 : /* 'E' key */
-                switchValue_a = Switch_E_a;
-                switchValue_b = Switch_E_b;
-                break;
-
-            case 0x2D : /* 'R' key */
-                switchValue_a = Switch_R_a;
-                switchValue_b = Switch_R_b;
-                break;
-
-            case 0x2C : /* 'T' key */
-                switchValue_a = Switch_T_a;
-                switchValue_b = Switch_T_b;
-                break;
-
-            case 0x6B :
-                if (extended)
-                { /* 'LEFT' key */
-                    switchValue_a = Switch_LEFT_a;
-                    switchValue_b = Switch_LEFT_b;
-                } else 
-                { /* Keypad '4' key */
-                    switchValue_a = Switch_4_a;
-                    switchValue_b = Switch_4_b;
-                }
-                break;
-
-            case 0x66 : /* 'BKSP' key (also mapped to 'LEFT' Key) */
-                switchValue_a = Switch_LEFT_a;
-                switchValue_b = Switch_LEFT_b;
-                break;
-
-            case 0x1C : /* 'A' key */
-                switchValue_a = Switch_A_a;
-                switchValue_b = Switch_A_b;
-                break;
-
-            case 0x1B : /* 'S' key */
-                switchValue_a = Switch_S_a;
-                switchValue_b = Switch_S_b;
-                break;
-
-            case 0x23 : /* 'D' key */
-                switchValue_a = Switch_D_a;
-                switchValue_b = Switch_D_b;
-                break;
-
-            case 0x2B : /* 'F' key */
-                switchValue_a = Switch_F_a;
-                switchValue_b = Switch_F_b;
-                break;
-
-            case 0x34 : /* 'G' key */
-                switchValue_a = Switch_G_a;
-                switchValue_b = Switch_G_b;
-                break;
-
-            case 0x12 :
-                if (extended == 0)
-                { /* Left 'SHIFT' key */
-                    switchValue_a = Switch_SHIFT;
-                }
-                break;
-
-            case 0x59 : /* Right 'SHIFT' key */
-                switchValue_a = Switch_SHIFT;
-                break;
-
-            case 0x1A : /* 'Z' key */
-                switchValue_a = Switch_Z_a;
-                switchValue_b = Switch_Z_b;
-                break;
-
-            case 0x22 : /* 'X' key */
-                switchValue_a = Switch_X_a;
-                switchValue_b = Switch_X_b;
-                break;
-
-            case 0x21 : /* 'C' key */
-                switchValue_a = Switch_C_a;
-                switchValue_b = Switch_C_b;
-                break;
-
-            case 0x2A : /* 'V' key */
-                switchValue_a = Switch_V_a;
-                switchValue_b = Switch_V_b;
-                break;
-
-            case 0x32 : /* 'B' key */
-                switchValue_a = Switch_B_a;
-                switchValue_b = Switch_B_b;
-                break;
-
-            case 0x14 : /* Left or Right 'CTRL' key */
-                switchValue_a = Switch_CNTL;
-                break;
-/*
- * Then check ScanCodes of interest for the Right Controller Keyboard (24 keys)
- */
-            case 0x3D : /* '7' key */
-                switchValue_a = Switch_7_a;
-                switchValue_b = Switch_7_b;
-                break;
-
-            case 0x6C :
-                if (extended == 0)
-                { /* Keypad '7' key */
-                    switchValue_a = Switch_7_a;
-                    switchValue_b = Switch_7_b;
-                }
-                break;
-
-            case 0x3E : /* '8' key */
-                switchValue_a = Switch_8_a;
-                switchValue_b = Switch_8_b;
-                break;
-
-            case 0x75 :
-                if (extended == 0)
-                { /* Keypad '8' key */
-                    switchValue_a = Switch_8_a;
-                    switchValue_b = Switch_8_b;
-                }
-                break;
-
-            case 0x46 : /* '9' key */
-                switchValue_a = Switch_9_a;
-                switchValue_b = Switch_9_b;
-                break;
-
-            case 0x7D :
-                if (extended == 0)
-                { /* Keypad '9' key */
-                    switchValue_a = Switch_9_a;
-                    switchValue_b = Switch_9_b;
-                }
-                break;
-
-            case 0x45 : /* '0' key */
-                switchValue_a = Switch_0_a;
-                switchValue_b = Switch_0_b;
-                break;
-
-            case 0x70 :
-                if (extended == 0)
-                { /* Keypad '0' key */
-                    switchValue_a = Switch_0_a;
-                    switchValue_b = Switch_0_b;
-                }
-                break;
-
-            case 0x52 : /* ':' key - NOTE: Mapped to PS/2 Keyboard ' key */
-                switchValue_a = Switch_COLON_a;
-                switchValue_b = Switch_COLON_b;
-                break;
-
-            case 0x4E : /* '-' key */
-                switchValue_a = Switch_MINUS;
-                break;
-
-            case 0x7B : /* Keypad '-' key */
-                switchValue_a = Switch_MINUS;
-                break;
-
-            case 0x35 : /* 'Y' key */
-                switchValue_a = Switch_Y_a;
-                switchValue_b = Switch_Y_b;
-                break;
-
-            case 0x3C : /* 'U' key */
-                switchValue_a = Switch_U_a;
-                switchValue_b = Switch_U_b;
-                break;
-
-            case 0x43 : /* 'I' key */
-                switchValue_a = Switch_I_a;
-                switchValue_b = Switch_I_b;
-                break;
-
-            case 0x44 : /* 'O' key */
-                switchValue_a = Switch_O_a;
-                switchValue_b = Switch_O_b;
-                break;
-
-            case 0x4D : /* 'P' key */
-                switchValue_a = Switch_P_a;
-                switchValue_b = Switch_P_b;
-                break;
-
-            case 0x5A : /* Keypad or regular 'ENTER' key */
-                switchValue_a = Switch_RETN_a;
-                switchValue_b = Switch_RETN_b;
-                break;
-
-            case 0x33 : /* 'H' key */
-                switchValue_a = Switch_H_a;
-                switchValue_b = Switch_H_b;
-                break;
-
-            case 0x3B : /* 'J' key */
-                switchValue_a = Switch_J_a;
-                switchValue_b = Switch_J_b;
-                break;
-
-            case 0x42 : /* 'K' key */
-                switchValue_a = Switch_K_a;
-                switchValue_b = Switch_K_b;
-                break;
-
-            case 0x4B : /* 'L' key */
-                switchValue_a = Switch_L_a;
-                switchValue_b = Switch_L_b;
-                break;
-
-            case 0x4C : /* ';' key */
-                switchValue_a = Switch_SEMICOLON_a;
-                switchValue_b = Switch_SEMICOLON_b;
-                break;
-
-            case 0x31 : /* 'N' key */
-                switchValue_a = Switch_N_a;
-                switchValue_b = Switch_N_b;
-                break;
-
-            case 0x3A : /* 'M' key */
-                switchValue_a = Switch_M_a;
-                switchValue_b = Switch_M_b;
-                break;
-
-            case 0x41 : /* ',' key */
-                switchValue_a = Switch_COMMA_a;
-                switchValue_b = Switch_COMMA_b;
-                break;
-
-            case 0x49 : /* '.' key */
-                switchValue_a = Switch_PERIOD_a;
-                switchValue_b = Switch_PERIOD_b;
-                break;
-
-            case 0x71 :
-                if (extended == 0)
-                { /* Keypad '.' key */
-                    switchValue_a = Switch_PERIOD_a;
-                    switchValue_b = Switch_PERIOD_b;
-                }
-                break;
-
-            case 0x4A : /* Keypad or regular '/' key */
-                switchValue_a = Switch_FORWARDSLASH_a;
-                switchValue_b = Switch_FORWARDSLASH_b;
-                break;
-
-            case 0x74 :
-                if (extended)
-                { /* 'RIGHT' key */
-                    switchValue_a = Switch_RIGHT;
-                } else 
-                { /* Keypad '6' key */
-                    switchValue_a = Switch_6_a;
-                    switchValue_b = Switch_6_b;
+        queued &= switchState ? MT8816_Shadow[lp1] : ~MT8816_Shadow[lp1];
+        if (queued == 0)
+            continue;
+
+        for(uint8_t lp2 = 0; lp2 < 8; lp2++ )
+            if (queued & Crosspoint_bm[lp2])
+            {
+                if (count == MT8816_DRAIN_STROBES)
+                    return count;
+
+                portValues[count++] = MT8816_PortValue((lp1 << 3) | lp2)
+                                      | (switchState ? MT_Data_bm : 0);
+                MT8816_Queued[lp1] &= ~Crosspoint_bm[lp2];
+            }
+    }
+    return count;
+}
+
+/*
+ * MT8816 write queue drain - INTERRUPT SERVICE ROUTINE!
+ * Interrupt is called every MT8816_DRAIN_us (TCB2), while anything is
+ * queued. Switches Off are written before Switches On (as Route_Commit
+ * did), back-to-back in groups of MT8816_ATOMIC_STROBES (so both poles of a
+ * key still change together).
+ */
+ISR(TCB2_INT_vect)
+{
+    uint8_t portValues[MT8816_DRAIN_STROBES];
+    uint8_t count;
+    uint8_t lp = 0;
+
+    TCB2.INTFLAGS = TCB_CAPT_bm;
+
+    count = MT8816_Drain_List(false, portValues, 0);
+    count = MT8816_Drain_List(true, portValues, count);
+
+    while (lp < count)
+    {
+        uint8_t strobes = 0;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            do
+                MT8816_Strobe(portValues[lp++]);
+            while ((lp < count) && (++strobes < MT8816_ATOMIC_STROBES));
+        }
+    }
+
+    MT8816_QueueDepth -= count;
+    Health_Hot.mt8816_Strobes += count;
+    if (MT8816_QueueDepth == 0)
+        TCB2.INTCTRL = 0;
+}
+
+/*
+ * MT8816_Queue_Flush drops every queued change, and holds off the drain,
+ * for MT8816_Reset (which switches the MT8816 Off directly).
+ */
+static inline void MT8816_Queue_Flush(void)
+{
+    MT8816_Drain_Hold();
+    for(uint8_t lp = 0; lp < sizeof(MT8816_Queued); lp++ )
+        MT8816_Queued[lp] = 0;
+    MT8816_QueueDepth = 0;
+}
+#endif
+
+#ifdef MT8816_RESET_VPORT
+/**
+ * MT8816_Reset_Pulse pulses the MT8816 RESET input, turning all switches OFF
+ */
+static inline void MT8816_Reset_Pulse(void)
+{
+    MT8816_RESET_VPORT.OUT |= MT8816_RESET_bm;
+    MT8816_DELAY(MT8816_RESET_CYCLES);
+    MT8816_RESET_VPORT.OUT &= ~MT8816_RESET_bm;
+}
+#endif
+
+/**
+ * MT8816_Reset resets all Switches to the OFF state (and the shadow state)
+ * NOTE: This should be entirely unnecessary if an appropriate
+ *       hardware reset of the MT8816 is in place!
+ *       But, to accommodate a software only reset option (no hardware reset),
+ *       this is retained. With a hardware reset in place this then becomes
+ *       just a "to be sure" reset. Why not? ;)
+ *       Where MT8816_RESET_VPORT is defined, the RESET input is pulsed.
+ *       Otherwise all 64 crosspoints are strobed OFF. As every crosspoint is
+ *       cleared, the port values are used directly (no truth table decode).
+ *       Any queued changes are dropped (MT8816_WRITE_QUEUE).
+ */
+static void MT8816_Reset(void)
+{
+    MT8816_Own();
+#ifdef MT8816_WRITE_QUEUE
+    MT8816_Queue_Flush();
+#endif
+#ifdef MT8816_RESET_VPORT
+    MT8816_Reset_Pulse();
+#else
+    for(uint8_t portValue = 0; portValue < MT8816_CROSSPOINTS; portValue++ )
+        MT8816_Strobe(portValue);
+    Health.mt8816_Writes += MT8816_CROSSPOINTS;
+#endif
+    for(uint8_t lp = 0; lp < sizeof(MT8816_Shadow); lp++ )
+        MT8816_Shadow[lp] = 0;
+    MT8816_Release();
+}
+
+/*
+ * Input Routing
+ * -------------
+ * All inputs are Route Sources, and each Source is routed to a 64-bit
+ * crosspoint mask (i.e. the MT8816 switches it turns On):
+ *  - CreatiVision keyboard keys (PS/2 ScanCodes are mapped to these by
+ *    the PS2_Keymap table),
+ *  - the Joystick bits (Up, Down, Left, Right, Button 1 & 2, and the Sega
+ *    pad extra buttons, per side),
+ *  - virtual Sources (e.g. the Joystick diagonal Extra switches).
+ *
+ * The Sources currently active are held in the Route_Active bit set, and
+ * the MT8816 target state is simply the OR of the active Sources' masks.
+ * Route_Commit then switches only the crosspoints which differ from the
+ * MT8816 shadow state. So a crosspoint shared by several Sources (e.g.
+ * Key 1 pole a = Left Joystick Up, or Key 2 / Key 3 pole a) stays On
+ * until the last Source holding it is released.
+ *
+ * Route_Table & PS2_Keymap are pointers, so remapping at runtime is just
+ * a pointer change.
+ */
+enum Route_Source
+{
+    ROUTE_NONE = 0,
+
+    /* CreatiVision Left Controller Keyboard (24 keys) */
+    ROUTE_KEY_1, ROUTE_KEY_2, ROUTE_KEY_3, ROUTE_KEY_4, ROUTE_KEY_5,
+    ROUTE_KEY_6, ROUTE_KEY_CNTL, ROUTE_KEY_Q, ROUTE_KEY_W, ROUTE_KEY_E,
+    ROUTE_KEY_R, ROUTE_KEY_T, ROUTE_KEY_LEFT, ROUTE_KEY_A, ROUTE_KEY_S,
+    ROUTE_KEY_D, ROUTE_KEY_F, ROUTE_KEY_G, ROUTE_KEY_SHIFT, ROUTE_KEY_Z,
+    ROUTE_KEY_X, ROUTE_KEY_C, ROUTE_KEY_V, ROUTE_KEY_B,
+
+    /* CreatiVision Right Controller Keyboard (24 keys) */
+    ROUTE_KEY_7, ROUTE_KEY_8, ROUTE_KEY_9, ROUTE_KEY_0, ROUTE_KEY_COLON,
+    ROUTE_KEY_MINUS, ROUTE_KEY_Y, ROUTE_KEY_U, ROUTE_KEY_I, ROUTE_KEY_O,
+    ROUTE_KEY_P, ROUTE_KEY_RETN, ROUTE_KEY_H, ROUTE_KEY_J, ROUTE_KEY_K,
+    ROUTE_KEY_L, ROUTE_KEY_SEMICOLON, ROUTE_KEY_N, ROUTE_KEY_M,
+    ROUTE_KEY_COMMA, ROUTE_KEY_PERIOD, ROUTE_KEY_FORWARDSLASH,
+    ROUTE_KEY_RIGHT, ROUTE_KEY_SPACE,
+
+    /*
+     * Joysticks (each side is byte aligned in Route_Active)
+     * Directions & Diagonal Extras (byte 0), then Buttons (byte 1), and
+     * the Sega pad extra buttons (rest of byte 1)
+     */
+    ROUTE_JOYL = 64,
+    ROUTE_JOYL_UP = ROUTE_JOYL, ROUTE_JOYL_DOWN, ROUTE_JOYL_LEFT,
+    ROUTE_JOYL_RIGHT, ROUTE_JOYL_UPLEFT, ROUTE_JOYL_UPRIGHT,
+    ROUTE_JOYL_DOWNLEFT, ROUTE_JOYL_DOWNRIGHT,
+    ROUTE_JOYL_BUTTON1, ROUTE_JOYL_BUTTON2,
+    ROUTE_JOYL_START, ROUTE_JOYL_C, ROUTE_JOYL_X, ROUTE_JOYL_Y,
+    ROUTE_JOYL_Z, ROUTE_JOYL_MODE,
+
+    ROUTE_JOYR = 80,
+    ROUTE_JOYR_UP = ROUTE_JOYR, ROUTE_JOYR_DOWN, ROUTE_JOYR_LEFT,
+    ROUTE_JOYR_RIGHT, ROUTE_JOYR_UPLEFT, ROUTE_JOYR_UPRIGHT,
+    ROUTE_JOYR_DOWNLEFT, ROUTE_JOYR_DOWNRIGHT,
+    ROUTE_JOYR_BUTTON1, ROUTE_JOYR_BUTTON2,
+    ROUTE_JOYR_START, ROUTE_JOYR_C, ROUTE_JOYR_X, ROUTE_JOYR_Y,
+    ROUTE_JOYR_Z, ROUTE_JOYR_MODE,
+
+    ROUTE_SOURCES = 96
+};
+
+/* Route_Active bytes holding the keyboard key Sources */
+#define ROUTE_KEY_BYTES (ROUTE_JOYL / 8)
+
+/*
+ * 64-bit crosspoint mask, with the same bit layout as the MT8816 shadow
+ * state (AVR is little-endian, so byte n holds crosspoints n*8 - n*8+7)
+ */
+typedef union
+{
+    uint64_t all;
+    uint8_t  bytes[MT8816_CROSSPOINTS / 8];
+} Crosspoint_Mask;
+
+#define XP(switchAddress) (1ULL << ((switchAddress) & 0x3F))
+
+/*
+ * Default Routes (Source -> crosspoint mask)
+ * Defined as an initializer list, so each Route Profile can start from the
+ * defaults and just override the Sources it routes differently.
+ */
+#define ROUTE_DEFAULTS                                                                \
+    /* CreatiVision Left Controller Keyboard (24 keys) */                             \
+    [ROUTE_KEY_1]      = XP(Switch_1_a) | XP(Switch_1_b),                             \
+    [ROUTE_KEY_2]      = XP(Switch_2_a) | XP(Switch_2_b),                             \
+    [ROUTE_KEY_3]      = XP(Switch_3_a) | XP(Switch_3_b),                             \
+    [ROUTE_KEY_4]      = XP(Switch_4_a) | XP(Switch_4_b),                             \
+    [ROUTE_KEY_5]      = XP(Switch_5_a) | XP(Switch_5_b),                             \
+    [ROUTE_KEY_6]      = XP(Switch_6_a) | XP(Switch_6_b),                             \
+    [ROUTE_KEY_CNTL]   = XP(Switch_CNTL),                                             \
+    [ROUTE_KEY_Q]      = XP(Switch_Q_a) | XP(Switch_Q_b),                             \
+    [ROUTE_KEY_W]      = XP(Switch_W_a) | XP(Switch_W_b),                             \
+    [ROUTE_KEY_E]      = XP(Switch_E_a) | XP(Switch_E_b),                             \
+    [ROUTE_KEY_R]      = XP(Switch_R_a) | XP(Switch_R_b),                             \
+    [ROUTE_KEY_T]      = XP(Switch_T_a) | XP(Switch_T_b),                             \
+    [ROUTE_KEY_LEFT]   = XP(Switch_LEFT_a) | XP(Switch_LEFT_b),                       \
+    [ROUTE_KEY_A]      = XP(Switch_A_a) | XP(Switch_A_b),                             \
+    [ROUTE_KEY_S]      = XP(Switch_S_a) | XP(Switch_S_b),                             \
+    [ROUTE_KEY_D]      = XP(Switch_D_a) | XP(Switch_D_b),                             \
+    [ROUTE_KEY_F]      = XP(Switch_F_a) | XP(Switch_F_b),                             \
+    [ROUTE_KEY_G]      = XP(Switch_G_a) | XP(Switch_G_b),                             \
+    [ROUTE_KEY_SHIFT]  = XP(Switch_SHIFT),                                            \
+    [ROUTE_KEY_Z]      = XP(Switch_Z_a) | XP(Switch_Z_b),                             \
+    [ROUTE_KEY_X]      = XP(Switch_X_a) | XP(Switch_X_b),                             \
+    [ROUTE_KEY_C]      = XP(Switch_C_a) | XP(Switch_C_b),                             \
+    [ROUTE_KEY_V]      = XP(Switch_V_a) | XP(Switch_V_b),                             \
+    [ROUTE_KEY_B]      = XP(Switch_B_a) | XP(Switch_B_b),                             \
+                                                                                      \
+    /* CreatiVision Right Controller Keyboard (24 keys) */                            \
+    [ROUTE_KEY_7]      = XP(Switch_7_a) | XP(Switch_7_b),                             \
+    [ROUTE_KEY_8]      = XP(Switch_8_a) | XP(Switch_8_b),                             \
+    [ROUTE_KEY_9]      = XP(Switch_9_a) | XP(Switch_9_b),                             \
+    [ROUTE_KEY_0]      = XP(Switch_0_a) | XP(Switch_0_b),                             \
+    [ROUTE_KEY_COLON]  = XP(Switch_COLON_a) | XP(Switch_COLON_b),                     \
+    [ROUTE_KEY_MINUS]  = XP(Switch_MINUS),                                            \
+    [ROUTE_KEY_Y]      = XP(Switch_Y_a) | XP(Switch_Y_b),                             \
+    [ROUTE_KEY_U]      = XP(Switch_U_a) | XP(Switch_U_b),                             \
+    [ROUTE_KEY_I]      = XP(Switch_I_a) | XP(Switch_I_b),                             \
+    [ROUTE_KEY_O]      = XP(Switch_O_a) | XP(Switch_O_b),                             \
+    [ROUTE_KEY_P]      = XP(Switch_P_a) | XP(Switch_P_b),                             \
+    [ROUTE_KEY_RETN]   = XP(Switch_RETN_a) | XP(Switch_RETN_b),                       \
+    [ROUTE_KEY_H]      = XP(Switch_H_a) | XP(Switch_H_b),                             \
+    [ROUTE_KEY_J]      = XP(Switch_J_a) | XP(Switch_J_b),                             \
+    [ROUTE_KEY_K]      = XP(Switch_K_a) | XP(Switch_K_b),                             \
+    [ROUTE_KEY_L]      = XP(Switch_L_a) | XP(Switch_L_b),                             \
+    [ROUTE_KEY_SEMICOLON] = XP(Switch_SEMICOLON_a) | XP(Switch_SEMICOLON_b),          \
+    [ROUTE_KEY_N]      = XP(Switch_N_a) | XP(Switch_N_b),                             \
+    [ROUTE_KEY_M]      = XP(Switch_M_a) | XP(Switch_M_b),                             \
+    [ROUTE_KEY_COMMA]  = XP(Switch_COMMA_a) | XP(Switch_COMMA_b),                     \
+    [ROUTE_KEY_PERIOD] = XP(Switch_PERIOD_a) | XP(Switch_PERIOD_b),                   \
+    [ROUTE_KEY_FORWARDSLASH] = XP(Switch_FORWARDSLASH_a) | XP(Switch_FORWARDSLASH_b), \
+    [ROUTE_KEY_RIGHT]  = XP(Switch_RIGHT),                                            \
+    [ROUTE_KEY_SPACE]  = XP(Switch_SPACE_a) | XP(Switch_SPACE_b),                     \
+                                                                                      \
+    /* CreatiVision Left Controller Joystick */                                       \
+    [ROUTE_JOYL_UP]        = XP(Switch_JoyL_Up),                                      \
+    [ROUTE_JOYL_DOWN]      = XP(Switch_JoyL_Down),                                    \
+    [ROUTE_JOYL_LEFT]      = XP(Switch_JoyL_Left),                                    \
+    [ROUTE_JOYL_RIGHT]     = XP(Switch_JoyL_Right),                                   \
+    [ROUTE_JOYL_UPLEFT]    = XP(Switch_JoyL_UpLeft_Extra),                            \
+    [ROUTE_JOYL_UPRIGHT]   = XP(Switch_JoyL_UpRightDownLeft_Extra),                   \
+    [ROUTE_JOYL_DOWNLEFT]  = XP(Switch_JoyL_UpRightDownLeft_Extra),                   \
+    [ROUTE_JOYL_DOWNRIGHT] = XP(Switch_JoyL_DownRight_Extra),                         \
+    [ROUTE_JOYL_BUTTON1]   = XP(Switch_JoyL_Button1),                                 \
+    [ROUTE_JOYL_BUTTON2]   = XP(Switch_JoyL_Button2),                                 \
+    [ROUTE_JOYL_START]     = SEGA_START_ROUTE,                                        \
+    [ROUTE_JOYL_C]         = SEGA_C_ROUTE,                                            \
+    [ROUTE_JOYL_X]         = SEGA_X_ROUTE,                                            \
+    [ROUTE_JOYL_Y]         = SEGA_Y_ROUTE,                                            \
+    [ROUTE_JOYL_Z]         = SEGA_Z_ROUTE,                                            \
+    [ROUTE_JOYL_MODE]      = SEGA_MODE_ROUTE,                                         \
+                                                                                      \
+    /* CreatiVision Right Controller Joystick */                                      \
+    [ROUTE_JOYR_UP]        = XP(Switch_JoyR_Up),                                      \
+    [ROUTE_JOYR_DOWN]      = XP(Switch_JoyR_Down),                                    \
+    [ROUTE_JOYR_LEFT]      = XP(Switch_JoyR_Left),                                    \
+    [ROUTE_JOYR_RIGHT]     = XP(Switch_JoyR_Right),                                   \
+    [ROUTE_JOYR_UPLEFT]    = XP(Switch_JoyR_UpLeft_Extra),                            \
+    [ROUTE_JOYR_UPRIGHT]   = XP(Switch_JoyR_UpRightDownLeft_Extra),                   \
+    [ROUTE_JOYR_DOWNLEFT]  = XP(Switch_JoyR_UpRightDownLeft_Extra),                   \
+    [ROUTE_JOYR_DOWNRIGHT] = XP(Switch_JoyR_DownRight_Extra),                         \
+    [ROUTE_JOYR_BUTTON1]   = XP(Switch_JoyR_Button1),                                 \
+    [ROUTE_JOYR_BUTTON2]   = XP(Switch_JoyR_Button2),                                 \
+    [ROUTE_JOYR_START]     = SEGA_START_ROUTE,                                        \
+    [ROUTE_JOYR_C]         = SEGA_C_ROUTE,                                            \
+    [ROUTE_JOYR_X]         = SEGA_X_ROUTE,                                            \
+    [ROUTE_JOYR_Y]         = SEGA_Y_ROUTE,                                            \
+    [ROUTE_JOYR_Z]         = SEGA_Z_ROUTE,                                            \
+    [ROUTE_JOYR_MODE]      = SEGA_MODE_ROUTE,                                         \
+
+static const uint64_t Route_Default[ROUTE_SOURCES] = { ROUTE_DEFAULTS };
+
+/*
+ * Default PS/2 Keymap (ScanCode -> Route Source)
+ * [0] = ScanCodes, [1] = Extended (E0) ScanCodes
+ * ScanCodes not listed are of no interest to us (ROUTE_NONE).
+ * NOTE: Generated from tools/keymap/ps2_keymap.csv (see keymap_gen.py).
+ */
+/* BEGIN GENERATED PS2_KEYMAP (tools/keymap/keymap_gen.py) */
+static const uint8_t PS2_Keymap_Default[2][0x80] =
+{
+  {
+    /* CreatiVision Left Controller Keyboard (24 keys) */
+    [0x16] = ROUTE_KEY_1,     /* '1' key */
+    [0x69] = ROUTE_KEY_1,     /* Keypad '1' key */
+    [0x1E] = ROUTE_KEY_2,     /* '2' key */
+    [0x72] = ROUTE_KEY_2,     /* Keypad '2' key */
+    [0x26] = ROUTE_KEY_3,     /* '3' key */
+    [0x7A] = ROUTE_KEY_3,     /* Keypad '3' key */
+    [0x25] = ROUTE_KEY_4,     /* '4' key */
+    [0x6B] = ROUTE_KEY_4,     /* Keypad '4' key */
+    [0x2E] = ROUTE_KEY_5,     /* '5' key */
+    [0x73] = ROUTE_KEY_5,     /* Keypad '5' key */
+    [0x36] = ROUTE_KEY_6,     /* '6' key */
+    [0x74] = ROUTE_KEY_6,     /* Keypad '6' key */
+    [0x14] = ROUTE_KEY_CNTL,  /* Left 'CTRL' key */
+    [0x15] = ROUTE_KEY_Q,     /* 'Q' key */
+    [0x1D] = ROUTE_KEY_W,     /* 'W' key */
+    [0x24] = ROUTE_KEY_E,     /* 'E' key */
+    [0x2D] = ROUTE_KEY_R,     /* 'R' key */
+    [0x2C] = ROUTE_KEY_T,     /* 'T' key */
+    [0x66] = ROUTE_KEY_LEFT,  /* 'BKSP' key (also mapped to 'LEFT' Key) */
+    [0x1C] = ROUTE_KEY_A,     /* 'A' key */
+    [0x1B] = ROUTE_KEY_S,     /* 'S' key */
+    [0x23] = ROUTE_KEY_D,     /* 'D' key */
+    [0x2B] = ROUTE_KEY_F,     /* 'F' key */
+    [0x34] = ROUTE_KEY_G,     /* 'G' key */
+    [0x12] = ROUTE_KEY_SHIFT, /* Left 'SHIFT' key */
+    [0x59] = ROUTE_KEY_SHIFT, /* Right 'SHIFT' key */
+    [0x1A] = ROUTE_KEY_Z,     /* 'Z' key */
+    [0x22] = ROUTE_KEY_X,     /* 'X' key */
+    [0x21] = ROUTE_KEY_C,     /* 'C' key */
+    [0x2A] = ROUTE_KEY_V,     /* 'V' key */
+    [0x32] = ROUTE_KEY_B,     /* 'B' key */
+
+    /* CreatiVision Right Controller Keyboard (24 keys) */
+    [0x3D] = ROUTE_KEY_7,     /* '7' key */
+    [0x6C] = ROUTE_KEY_7,     /* Keypad '7' key */
+    [0x3E] = ROUTE_KEY_8,     /* '8' key */
+    [0x75] = ROUTE_KEY_8,     /* Keypad '8' key */
+    [0x46] = ROUTE_KEY_9,     /* '9' key */
+    [0x7D] = ROUTE_KEY_9,     /* Keypad '9' key */
+    [0x45] = ROUTE_KEY_0,     /* '0' key */
+    [0x70] = ROUTE_KEY_0,     /* Keypad '0' key */
+    [0x52] = ROUTE_KEY_COLON, /* ':' key - NOTE: Mapped to PS/2 ' key */
+    [0x4E] = ROUTE_KEY_MINUS, /* '-' key */
+    [0x7B] = ROUTE_KEY_MINUS, /* Keypad '-' key */
+    [0x35] = ROUTE_KEY_Y,     /* 'Y' key */
+    [0x3C] = ROUTE_KEY_U,     /* 'U' key */
+    [0x43] = ROUTE_KEY_I,     /* 'I' key */
+    [0x44] = ROUTE_KEY_O,     /* 'O' key */
+    [0x4D] = ROUTE_KEY_P,     /* 'P' key */
+    [0x5A] = ROUTE_KEY_RETN,  /* 'ENTER' key */
+    [0x33] = ROUTE_KEY_H,     /* 'H' key */
+    [0x3B] = ROUTE_KEY_J,     /* 'J' key */
+    [0x42] = ROUTE_KEY_K,     /* 'K' key */
+    [0x4B] = ROUTE_KEY_L,     /* 'L' key */
+    [0x4C] = ROUTE_KEY_SEMICOLON, /* ';' key */
+    [0x31] = ROUTE_KEY_N,     /* 'N' key */
+    [0x3A] = ROUTE_KEY_M,     /* 'M' key */
+    [0x41] = ROUTE_KEY_COMMA, /* ',' key */
+    [0x49] = ROUTE_KEY_PERIOD, /* '.' key */
+    [0x71] = ROUTE_KEY_PERIOD, /* Keypad '.' key */
+    [0x4A] = ROUTE_KEY_FORWARDSLASH, /* '/' key */
+    [0x29] = ROUTE_KEY_SPACE, /* 'SPACE' key */
+  },
+  {
+    /* CreatiVision Left Controller Keyboard (24 keys) */
+    [0x14] = ROUTE_KEY_CNTL,  /* Right 'CTRL' key */
+    [0x6B] = ROUTE_KEY_LEFT,  /* 'LEFT' key */
+
+    /* CreatiVision Right Controller Keyboard (24 keys) */
+    [0x5A] = ROUTE_KEY_RETN,  /* Keypad 'ENTER' key */
+    [0x4A] = ROUTE_KEY_FORWARDSLASH, /* Keypad '/' key */
+    [0x74] = ROUTE_KEY_RIGHT, /* 'RIGHT' key */
+  }
+};
+/* END GENERATED PS2_KEYMAP */
+
+/*
+ * Route Profiles
+ * --------------
+ * Different CreatiVision titles use different keys, so alternative Route
+ * Tables (and PS/2 Keymaps) are held in flash as Route Profiles.
+ * A Profile is selected at runtime with the hotkey chord:
+ *      'SCROLL LOCK' + 'F1' ... 'F4'  (Profile 1 ... 4)
+ * Switching Profile is just a pointer change (no tables are rebuilt), and
+ * the selected Profile is saved in EEPROM, to be restored at power on.
+ * The save is staged in RAM, and written by the Profile Save Task once the
+ * EEPROM is ready, so no Task ever waits on an EEPROM write.
+ * 
+ * Profile 1: Default
+ * Profile 2: Joystick Button 2 = 'SPACE' key
+ * Profile 3: Joystick Button 2 = 'RET'N' key
+ * Profile 4: Joystick Button 1 = 'SPACE' key, Button 2 = 'RET'N' key
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+
+static const uint64_t Route_Button2_SPACE[ROUTE_SOURCES] =
+{
+    ROUTE_DEFAULTS
+    [ROUTE_JOYL_BUTTON2] = XP(Switch_SPACE_a) | XP(Switch_SPACE_b),
+    [ROUTE_JOYR_BUTTON2] = XP(Switch_SPACE_a) | XP(Switch_SPACE_b),
+};
+
+static const uint64_t Route_Button2_RETN[ROUTE_SOURCES] =
+{
+    ROUTE_DEFAULTS
+    [ROUTE_JOYL_BUTTON2] = XP(Switch_RETN_a) | XP(Switch_RETN_b),
+    [ROUTE_JOYR_BUTTON2] = XP(Switch_RETN_a) | XP(Switch_RETN_b),
+};
+
+static const uint64_t Route_Buttons_SPACE_RETN[ROUTE_SOURCES] =
+{
+    ROUTE_DEFAULTS
+    [ROUTE_JOYL_BUTTON1] = XP(Switch_SPACE_a) | XP(Switch_SPACE_b),
+    [ROUTE_JOYR_BUTTON1] = XP(Switch_SPACE_a) | XP(Switch_SPACE_b),
+    [ROUTE_JOYL_BUTTON2] = XP(Switch_RETN_a) | XP(Switch_RETN_b),
+    [ROUTE_JOYR_BUTTON2] = XP(Switch_RETN_a) | XP(Switch_RETN_b),
+};
+
+#pragma GCC diagnostic pop
+
+typedef struct
+{
+    const uint64_t *route;
+    const uint8_t (*keymap)[0x80];
+} Route_Profile;
+
+static const Route_Profile Route_Profiles[] =
+{
+    { Route_Default,            PS2_Keymap_Default },
+    { Route_Button2_SPACE,      PS2_Keymap_Default },
+    { Route_Button2_RETN,       PS2_Keymap_Default },
+    { Route_Buttons_SPACE_RETN, PS2_Keymap_Default },
+};
+
+#define ROUTE_PROFILES (sizeof(Route_Profiles) / sizeof(Route_Profiles[0]))
+
+static uint8_t EEMEM Route_Profile_Saved = 0;
+
+static const uint64_t *Route_Table = Route_Default;
+static const uint8_t (*PS2_Keymap)[0x80] = PS2_Keymap_Default;
+
+static uint8_t Route_Active[ROUTE_SOURCES / 8];
+static uint8_t Route_Pending[ROUTE_SOURCES / 8]; /* Changed, not committed */
+
+#ifdef JOYSTICK_FAST_PATH
+/*
+ * Joystick fast path crosspoint masks (see Route_Commit_Joysticks)
+ *  Route_Fast_Rest      - crosspoints of all active non-Joystick Sources,
+ *  Route_Fast_Side      - crosspoints of each Joystick (Left, Right),
+ * as last committed, and for the active Route Profile, each Joystick's
+ * crosspoints by direction (0b0000RLDU) and by button nibble (Buttons 1 - 4,
+ * then the Sega extras), precalculated by Route_Fast_Initialize.
+ */
+static Crosspoint_Mask Route_Fast_Rest;
+static Crosspoint_Mask Route_Fast_Side[2];
+static uint64_t Route_Fast_Directions[2][16];
+static uint64_t Route_Fast_Buttons[2][2][16];
+#endif
+
+static void Route_Commit(void);
+
+/*
+ * Route_Update sets a Source active or inactive
+ */
+static inline void Route_Update(uint8_t source, bool active)
+{
+    if (active == true)
+        Route_Active[source >> 3] |= Crosspoint_bm[source & 0x07];
+    else
+        Route_Active[source >> 3] &= ~Crosspoint_bm[source & 0x07];
+}
+
+/*
+ * Route_Update_Deferred sets a Source active or inactive, to be committed
+ * later (i.e. once for a batch of updates). If the Source has already
+ * changed since the last commit, that change is committed first, so even a
+ * key pressed and released within one batch still reaches the console.
+ * NOTE: The caller MUST own the MT8816 until the batch is committed.
+ */
+static inline void Route_Update_Deferred(uint8_t source, bool active)
+{
+    uint8_t source_bm = Crosspoint_bm[source & 0x07];
+
+    if (((Route_Active[source >> 3] & source_bm) != 0) == active)
+        return;
+
+    if (Route_Pending[source >> 3] & source_bm)
+        Route_Commit();
+
+    Route_Update(source, active);
+    Route_Pending[source >> 3] |= source_bm;
+}
+
+/*
+ * Route_Target calculates the MT8816 target state, in one pass, as the OR
+ * of all active Sources' crosspoint masks. Inactive bytes of Sources are
+ * skipped, so the work is proportional to the number of active Sources.
+ * With JOYSTICK_FAST_PATH, the non-Joystick and each Joystick's Sources are
+ * gathered apart (Route_Fast_Rest / Route_Fast_Side), for the ISR commit.
+ */
+static void Route_Target(Crosspoint_Mask *target)
+{
+    target->all = 0;
+#ifdef JOYSTICK_FAST_PATH
+    Route_Fast_Rest.all = 0;
+    Route_Fast_Side[0].all = 0;
+    Route_Fast_Side[1].all = 0;
+#endif
+
+    for(uint8_t lp1 = 0; lp1 < sizeof(Route_Active); lp1++ )
+    {
+        uint8_t active = Route_Active[lp1];
+
+        if (active == 0)
+            continue;
+
+        const uint64_t *route = &Route_Table[lp1 << 3];
+#ifdef JOYSTICK_FAST_PATH
+        uint64_t *part = (lp1 < (ROUTE_JOYL / 8)) ? &Route_Fast_Rest.all :
+            &Route_Fast_Side[(lp1 - (ROUTE_JOYL / 8)) >> 1].all;
+#else
+        uint64_t *part = &target->all;
+#endif
+
+        for(uint8_t lp2 = 0; lp2 < 8; lp2++ )
+            if (active & Crosspoint_bm[lp2])
+                *part |= route[lp2];
+    }
+#ifdef JOYSTICK_FAST_PATH
+    target->all = Route_Fast_Rest.all | Route_Fast_Side[0].all |
+                  Route_Fast_Side[1].all;
+#endif
+}
+
+/*
+ * Route_Switch writes a commit's switch changes, Off before On (or posts
+ * them to the write queue), and counts a commit with no changes.
+ */
+static void Route_Switch(uint8_t *switchOff, uint8_t switchOffCount,
+                         uint8_t *switchOn, uint8_t switchOnCount)
+{
+#ifdef MT8816_WRITE_QUEUE
+    MT8816_Drain_Hold();
+    for(uint8_t lp = 0; lp < switchOffCount; lp++ )
+        MT8816_Post(false, switchOff[lp]);
+    for(uint8_t lp = 0; lp < switchOnCount; lp++ )
+        MT8816_Post(true, switchOn[lp]);
+    MT8816_Drain_Start();
+#else
+    if (switchOffCount)
+        MT8816_SwitchList(false, switchOff, switchOffCount);
+    if (switchOnCount)
+        MT8816_SwitchList(true, switchOn, switchOnCount);
+#endif
+    if ((switchOffCount | switchOnCount) == 0)
+        Health.mt8816_Suppressed++;
+}
+
+/*
+ * Route_Commit switches the MT8816 to the current target state.
+ * Only crosspoints which differ from the shadow state are written.
+ * Note that we switch Off any switches that need to be Off, before turning
+ * On any switches that need to be On! Each group is written back-to-back,
+ * so (for example) both poles of a key change together.
+ */
+static void Route_Commit(void)
+{
+    Crosspoint_Mask target;
+    uint8_t switchOff[MT8816_CROSSPOINTS];
+    uint8_t switchOn[MT8816_CROSSPOINTS];
+    uint8_t switchOffCount = 0;
+    uint8_t switchOnCount = 0;
+
+    MT8816_Own();
+    Route_Target(&target);
+
+    for(uint8_t lp1 = 0; lp1 < sizeof(target.bytes); lp1++ )
+    {
+        uint8_t changed = target.bytes[lp1] ^ MT8816_Shadow[lp1];
+
+        if (changed == 0)
+            continue;
+
+        for(uint8_t lp2 = 0; lp2 < 8; lp2++ )
+            if (changed & Crosspoint_bm[lp2])
+            {
+                if (target.bytes[lp1] & Crosspoint_bm[lp2])
+                    switchOn[switchOnCount++] = (lp1 << 3) | lp2;
+                else
+                    switchOff[switchOffCount++] = (lp1 << 3) | lp2;
+            }
+    }
+
+    Route_Switch(switchOff, switchOffCount, switchOn, switchOnCount);
+
+    for(uint8_t lp1 = 0; lp1 < sizeof(Route_Pending); lp1++ )
+        Route_Pending[lp1] = 0;
+    MT8816_Release();
+}
+
+/*
+ * Route_Commit_Pending commits the deferred updates, only if there are any,
+ * so a batch which changed no Source writes (and counts) nothing.
+ */
+static void Route_Commit_Pending(void)
+{
+    uint8_t pending = 0;
+
+    for(uint8_t lp = 0; lp < sizeof(Route_Pending); lp++ )
+        pending |= Route_Pending[lp];
+
+    if (pending)
+        Route_Commit();
+}
+
+/*
+ * Joystick direction (0b0000RLDU) to active direction Sources, as bits
+ * relative to the side's first Source (ROUTE_JOYx_UP = bit 0).
+ * Only the 4 single directions and 4 diagonals are valid, any other
+ * combination (e.g. Up + Down) switches all directions Off.
+ * Diagonals also turn On the matching Extra switch.
+ */
+#define JOY_UP        0x01
+#define JOY_DOWN      0x02
+#define JOY_LEFT      0x04
+#define JOY_RIGHT     0x08
+#define JOY_UPLEFT    0x10
+#define JOY_UPRIGHT   0x20
+#define JOY_DOWNLEFT  0x40
+#define JOY_DOWNRIGHT 0x80
+
+static const uint8_t Joystick_Directions[16] =
+{
+    [0x01] = JOY_UP,
+    [0x02] = JOY_DOWN,
+    [0x04] = JOY_LEFT,
+    [0x08] = JOY_RIGHT,
+    [0x05] = JOY_UP | JOY_LEFT | JOY_UPLEFT,
+    [0x09] = JOY_UP | JOY_RIGHT | JOY_UPRIGHT,
+    [0x06] = JOY_DOWN | JOY_LEFT | JOY_DOWNLEFT,
+    [0x0A] = JOY_DOWN | JOY_RIGHT | JOY_DOWNRIGHT,
+};
+
+/*
+ * Route_Joystick sets the active Sources for one Joystick (ROUTE_JOYL or
+ * ROUTE_JOYR), from its Joystick value (Buttons & any Sega extra buttons
+ * are in Source order).
+ */
+static inline void Route_Joystick(uint8_t joystickSource, Joystick_Value joyValue)
+{
+    Route_Active[joystickSource >> 3] = Joystick_Directions[joyValue & 0x0F];
+    Route_Active[(joystickSource >> 3) + 1] = (uint8_t)(joyValue >> 4);
+}
+
+#ifdef JOYSTICK_FAST_PATH
+/*
+ * Route_Fast_Initialize precalculates each Joystick's crosspoint masks for
+ * the active Route Profile, by direction and by button nibble, so the ISR
+ * looks up a Joystick's crosspoints in 3 reads (see Route_Commit_Joysticks).
+ * NOTE: The caller MUST own the MT8816.
+ */
+static void Route_Fast_Initialize(void)
+{
+    for(uint8_t side = 0; side < 2; side++ )
+    {
+        const uint64_t *route = &Route_Table[side ? ROUTE_JOYR : ROUTE_JOYL];
+
+        for(uint8_t value = 0; value < 16; value++ )
+        {
+            uint64_t directions = 0;
+            uint64_t buttonsLow = 0;
+            uint64_t buttonsHigh = 0;
+
+            for(uint8_t lp = 0; lp < 8; lp++ )
+                if (Joystick_Directions[value] & Crosspoint_bm[lp])
+                    directions |= route[lp];
+
+            for(uint8_t lp = 0; lp < 4; lp++ )
+                if (value & Crosspoint_bm[lp])
+                {
+                    buttonsLow |= route[8 + lp];
+                    buttonsHigh |= route[12 + lp];
                 }
-                break;
 
-            case 0x29 : /* 'SPACE' key */
-                switchValue_a = Switch_SPACE_a;
-                switchValue_b = Switch_SPACE_b;
-                break;
+            Route_Fast_Directions[side][value] = directions;
+            Route_Fast_Buttons[side][0][value] = buttonsLow;
+            Route_Fast_Buttons[side][1][value] = buttonsHigh;
+        }
+    }
+}
+#endif
+
+#ifndef PS2_MOUSE
+/**
+ * Keyboard_Release_All releases all keyboard key Sources (and commits),
+ * leaving any Joystick Sources untouched.
+ */
+static void Keyboard_Release_All(void)
+{
+    for(uint8_t lp = 0; lp < ROUTE_KEY_BYTES; lp++ )
+        Route_Active[lp] = 0;
+
+    Route_Commit();
+}
+#endif
+
+/*
+ * Route Profile staged to save (ROUTE_PROFILES = none), and since when
+ */
+static uint8_t Route_Profile_Staged = ROUTE_PROFILES;
+static uint16_t Route_Profile_Staged_Time;
+
+/**
+ * Route_Profile_Select switches to Route Profile (0 - ROUTE_PROFILES-1),
+ * and commits the changes (held keys & Joysticks take on their new routes).
+ * If save is true, the Profile is also staged to save to EEPROM.
+ */
+static void Route_Profile_Select(uint8_t profile, bool save)
+{
+    if (profile >= ROUTE_PROFILES)
+        profile = 0;
+
+    MT8816_Own();
+    Route_Table = Route_Profiles[profile].route;
+    PS2_Keymap = Route_Profiles[profile].keymap;
+#ifdef JOYSTICK_FAST_PATH
+    Route_Fast_Initialize();
+#endif
+    Route_Commit();
+    MT8816_Release();
+
+    if (save)
+    {
+        Route_Profile_Staged = profile;
+        Route_Profile_Staged_Time = Timebase_Now();
+    }
+}
+
+/*
+ * ready_Profile_Save is true once a staged Profile can be written, i.e.
+ * the EEPROM isn't still busy with a write (since = when it was staged).
+ */
+static bool ready_Profile_Save(uint16_t *since)
+{
+    *since = Route_Profile_Staged_Time;
+
+    return (Route_Profile_Staged < ROUTE_PROFILES) &&
+        !(NVMCTRL.STATUS & NVMCTRL_EEBUSY_bm);
+}
+
+/*
+ * process_Profile_Save writes the staged Profile to EEPROM (only if
+ * changed). The EEPROM isn't busy, so there is no earlier write to wait
+ * on, and the byte write itself completes in the background.
+ */
+static void process_Profile_Save(void)
+{
+    eeprom_update_byte(&Route_Profile_Saved, Route_Profile_Staged);
+    Route_Profile_Staged = ROUTE_PROFILES;
+}
+
+/**
+ * Route_Profile_Restore selects the Route Profile saved in EEPROM
+ * (an erased or invalid EEPROM value selects the Default Profile).
+ */
+static inline void Route_Profile_Restore(void)
+{
+    Route_Profile_Select(eeprom_read_byte(&Route_Profile_Saved), false);
+}
+
+/*
+ * Joystick port snapshot
+ * Both Joystick ports are sampled together, at the one point (VPORTC.IN then
+ * VPORTD.IN, single cycle reads, back to back), and both Joysticks are then
+ * decoded from that snapshot. So a change can't land between the reads of
+ * the one Joystick, or skew the Left and Right Joysticks apart, and PORTD
+ * (shared by both Joysticks) is read only once.
+ */
+typedef struct
+{
+    uint8_t portC;
+    uint8_t portD;
+} Joystick_Ports;
+
+static inline Joystick_Ports readJoystickPorts(void)
+{
+    Joystick_Ports ports;
+
+    ports.portC = VPORTC.IN;
+    ports.portD = VPORTD.IN;
+    return ports;
+}
+
+/**
+ *  Left Joystick uses PORTD PIN2 - PIN7
+ *  PORTD definitions:
+ *  PIN2 = Up
+ *  PIN3 = Down
+ *  PIN4 = Left
+ *  PIN5 = Right
+ *  PIN6 = Button 1
+ *  PIN7 = Button 2
+ *
+ * Read Left Joystick
+ * Returns 0 if no Joystick actions are engaged (all switches are off)
+ * else 0b00BBRLDU
+ * Specifically:
+ *  Up           = 0b00xxxxxU
+ *  Down         = 0b00xxxxDx
+ *  Left         = 0b00xxxLxx
+ *  Right        = 0b00xxRxxx
+ *  Button 1     = 0b00xBxxxx
+ *  Button 2     = 0b00Bxxxxx  
+ */
+static inline uint8_t readJoystickPort_Left(Joystick_Ports ports)
+{
+    uint8_t joyValD;
+    
+    joyValD = ~(ports.portD) & 0xFC;
+    
+    joyValD = joyValD >> 2;
+    return joyValD;
+}
+
+/**
+ *  Right Joystick uses PORTC PIN0 - PIN3 and PORTD PIN0 - PIN1
+ *  PORTC definitions:
+ *  PIN0 = Up
+ *  PIN1 = Down
+ *  PIN2 = Left
+ *  PIN3 = Right
+ * 
+ *  PORTD definitions:
+ *  PIN0 = Button 1
+ *  PIN1 = Button 2
+ *
+ * Read Right Joystick
+ * Returns 0 if no Joystick actions are engaged (all switches are off)
+ * else 0b00BBRLDU
+ * Specifically:
+ *  Up           = 0b00xxxxxU
+ *  Down         = 0b00xxxxDx
+ *  Left         = 0b00xxxLxx
+ *  Right        = 0b00xxRxxx
+ *  Button 1     = 0b00xBxxxx
+ *  Button 2     = 0b00Bxxxxx  
+ */
+static inline uint8_t readJoystickPort_Right(Joystick_Ports ports)
+{
+    uint8_t joyValC;
+    uint8_t joyValD;
+
+    joyValC = ~(ports.portC) & 0x0F;
+    joyValD = ~(ports.portD) & 0x03;
+    
+    joyValD = joyValD << 4;
+    return joyValC | joyValD;
+}
+
+/*
+ * readJoystick_Left / readJoystick_Right read a Joystick, as its port mode
+ * (see JOYSTICK_LEFT_MODE) has it:
+ *  JOYSTICK_MODE_ATARI  - the port pins (in the snapshot), as above,
+ *  JOYSTICK_MODE_ANALOG - the directions last decoded from the ADC samples
+ *                         (Analog_Directions, 0b0000RLDU), and the Buttons,
+ *  JOYSTICK_MODE_SNES / JOYSTICK_MODE_SEGA - the pad's last poll (Pad_Left
+ *                         or Pad_Right), including any Sega extra buttons.
+ * along with the PS/2 Mouse (Mouse_Joystick), if on that side.
+ */
+#if JOYSTICK_LEFT_MODE == JOYSTICK_MODE_ANALOG
+static volatile uint8_t Analog_Directions = 0;
+#endif
+
+#if defined(SNES_PAD) || defined(SEGA_PAD)
+static volatile Joystick_Value Pad_Left = 0;
+static volatile Joystick_Value Pad_Right = 0;
+#endif
+
+#ifdef PS2_MOUSE
+/*
+ * PS/2 Mouse movement (see PS2_MOUSE)
+ * Each movement packet sets each axis' direction (Joystick bit) and duty
+ * (On slots per modulator period), the buttons, and the slots left to hold
+ * them (set by decode_PS2_Mouse, in main). The modulator ISR composes
+ * Mouse_Joystick (0b00BBRLDU) from these every slot.
+ */
+typedef struct
+{
+    uint8_t dirX;
+    uint8_t dutyX;
+    uint8_t dirY;
+    uint8_t dutyY;
+    uint8_t buttons;
+    uint8_t hold;
+} Mouse_Motion;
+
+static volatile Mouse_Motion Mouse;
+static volatile uint8_t Mouse_Joystick = 0;
+#endif
+
+static inline Joystick_Value readJoystick_Left(Joystick_Ports ports)
+{
+    Joystick_Value joy;
+
+#if JOYSTICK_LEFT_MODE == JOYSTICK_MODE_ANALOG
+    joy = (readJoystickPort_Left(ports) & 0x30) | Analog_Directions;
+#elif JOYSTICK_LEFT_MODE != JOYSTICK_MODE_ATARI
+    (void)ports;
+    joy = Pad_Left;
+#else
+    joy = readJoystickPort_Left(ports);
+#endif
+#if defined(PS2_MOUSE) && !defined(MOUSE_JOYSTICK_RIGHT)
+    joy |= Mouse_Joystick;
+#endif
+    return joy;
+}
+
+static inline Joystick_Value readJoystick_Right(Joystick_Ports ports)
+{
+    Joystick_Value joy;
+
+#if JOYSTICK_RIGHT_MODE != JOYSTICK_MODE_ATARI
+    (void)ports;
+    joy = Pad_Right;
+#else
+    joy = readJoystickPort_Right(ports);
+#endif
+#if defined(PS2_MOUSE) && defined(MOUSE_JOYSTICK_RIGHT)
+    joy |= Mouse_Joystick;
+#endif
+    return joy;
+}
+
+#ifdef CONTROLLER_CHECK_INVARIANTS
+/*
+ * Crosspoint invariant checking (debug builds only)
+ * Define CONTROLLER_CHECK_INVARIANTS to check, after every batch of decoded
+ * ScanCodes, that the MT8816 shadow state is exactly the Route target state
+ * (i.e. the crosspoints of the active Sources). A mismatch means switch
+ * state has leaked (i.e. a stuck or lost switch), and is counted for
+ * inspection in the debugger.
+ * tools/fuzz runs the decoder on the host, with this check, against a mock
+ * MT8816 (see fuzz_ps2.c).
+ */
+static uint16_t Invariant_Fail_Count = 0;
+
+static void check_Crosspoint_Invariants(void)
+{
+    Crosspoint_Mask target;
+
+    MT8816_Own();
+    Route_Target(&target);
+
+    for(uint8_t lp = 0; lp < sizeof(MT8816_Shadow); lp++ )
+        if (MT8816_Shadow[lp] != target.bytes[lp])
+        {
+            Invariant_Fail_Count++;
+            break;
+        }
+    MT8816_Release();
+}
+#endif
+
+/*
+ * Keyboard Joystick mode (toggled On / Off by the PS/2 'NUM LOCK' key)
+ * 
+ * For those without Atari Joysticks, the PS/2 Keypad 8/2/4/6 (and the
+ * arrow keys) are Up/Down/Left/Right, Keypad 7/9/1/3 are the diagonals,
+ * and the two Fire keys are Buttons 1 & 2. Held keys are combined (e.g.
+ * Keypad 8 + Keypad 4 = Up Left) into a 0b00BBRLDU Joystick value, which
+ * is merged with the selected physical Joystick's value (see KeyJoy_Merge),
+ * so it drives the exact same 8-way switch logic (Extra switches included).
+ * 
+ * Fire keys are given as ScanCodes, with 0xE0nn for an extended ScanCode.
+ * e.g. 0x0070 = Keypad '0', 0xE05A = Keypad 'ENTER'
+ * NOTE: Like the rest of the keyboard decoding, this isn't built with
+ *       PS2_MOUSE (KeyJoy_Joystick then just stays 0).
+ */
+static const bool     KeyJoy_Right = false; /* false = Left Joystick */
+
+static uint8_t KeyJoy_Joystick = 0;
+
+#ifndef PS2_MOUSE
+static const uint16_t KeyJoy_Fire1 = 0x0070; /* Keypad '0' */
+static const uint16_t KeyJoy_Fire2 = 0x0071; /* Keypad '.' */
+
+static bool KeyJoy_Enabled = false;
+static uint16_t KeyJoy_Held = 0;
+
+/*
+ * Keyboard Joystick keys, and their 0b00BBRLDU Joystick value bits.
+ * (Fire keys are the last two entries, filled in from the settings above)
+ */
+#define KEYJOY_KEYS 14
+
+static const uint16_t KeyJoy_Keys[KEYJOY_KEYS - 2] =
+{
+    0x0075, /* Keypad '8' */
+    0x0072, /* Keypad '2' */
+    0x006B, /* Keypad '4' */
+    0x0074, /* Keypad '6' */
+    0x006C, /* Keypad '7' */
+    0x007D, /* Keypad '9' */
+    0x0069, /* Keypad '1' */
+    0x007A, /* Keypad '3' */
+    0xE075, /* 'UP' key */
+    0xE072, /* 'DOWN' key */
+    0xE06B, /* 'LEFT' key */
+    0xE074, /* 'RIGHT' key */
+};
+
+static const uint8_t KeyJoy_Bits[KEYJOY_KEYS] =
+{
+    0x01, 0x02, 0x04, 0x08, /* Up, Down, Left, Right */
+    0x05, 0x09, 0x06, 0x0A, /* Up Left, Up Right, Down Left, Down Right */
+    0x01, 0x02, 0x04, 0x08, /* Up, Down, Left, Right */
+    0x10, 0x20              /* Button 1, Button 2 */
+};
+
+/*
+ * KeyJoy_Key returns the Keyboard Joystick key index for a ScanCode
+ * (0xE0nn if extended), or KEYJOY_KEYS if it isn't a Keyboard Joystick key.
+ */
+static inline uint8_t KeyJoy_Key(uint16_t keyCode)
+{
+    uint8_t key;
+
+    for(key = 0; key < (KEYJOY_KEYS - 2); key++ )
+        if (KeyJoy_Keys[key] == keyCode)
+            return key;
+
+    if (keyCode == KeyJoy_Fire1)
+        return KEYJOY_KEYS - 2;
+    if (keyCode == KeyJoy_Fire2)
+        return KEYJOY_KEYS - 1;
+
+    return KEYJOY_KEYS;
+}
+#endif
+
+/*
+ * Joystick inputs, as at the last processed Joystick input event
+ */
+static Joystick_Value Joystick_Left = 0;
+static Joystick_Value Joystick_Right = 0;
+
+/*
+ * KeyJoy_Merge merges the Keyboard Joystick value into its physical
+ * Joystick's value. Buttons are simply ORed, but each axis (Up / Down,
+ * Left / Right) is taken from just one of the two, whichever last pressed
+ * a direction on it (or the other, once that one lets go). So e.g. a held
+ * physical Left, then Keyboard Right, is Right (not an opposite direction
+ * combination, i.e. all directions Off), and Left again on its release.
+ */
+static inline Joystick_Value KeyJoy_Merge(Joystick_Value joystick)
+{
+    static uint8_t joystick_prev = 0;
+    static uint8_t keyJoy_prev = 0;
+    static uint8_t keyJoy_axes = 0;
+
+    uint8_t directions = (uint8_t)joystick & 0x0F;
+    uint8_t keyJoy = KeyJoy_Joystick;
+
+    for(uint8_t axis = 0x03; axis <= 0x0C; axis <<= 2)
+    {
+        if (keyJoy & ~keyJoy_prev & axis)
+            keyJoy_axes |= axis;
+        else if (directions & ~joystick_prev & axis)
+            keyJoy_axes &= ~axis;
+
+        if (!(keyJoy & axis))
+            keyJoy_axes &= ~axis;
+        else if (!(directions & axis))
+            keyJoy_axes |= axis;
+    }
+    joystick_prev = directions;
+    keyJoy_prev = keyJoy;
+
+    return (joystick & ~(Joystick_Value)keyJoy_axes) | 
+           (keyJoy & (0x30 | keyJoy_axes));
+}
+
+/* Joystick values as last routed (Left, Right), KeyJoy merged */
+static Joystick_Value Joystick_Routed[2];
+
+/*
+ * route_Joystick_Left takes the current Left Joystick input and if changed,
+ *  routes it to the Left Joystick Sources (for 8-way Joystick switch input
+ *  for the CreatiVision), to be committed by the caller.
+ * Returns true if changed.
+ */
+static inline bool route_Joystick_Left(void)
+{
+    Joystick_Value joyLeft = Joystick_Left;
+
+    if (!KeyJoy_Right)
+        joyLeft = KeyJoy_Merge(joyLeft);
+
+    if (joyLeft == Joystick_Routed[0])
+        return false;
+
+    Route_Joystick(ROUTE_JOYL, joyLeft);
+    Joystick_Routed[0] = joyLeft;
+    return true;
+}
+
+/*
+ * route_Joystick_Right takes the current Right Joystick input and if changed,
+ *  routes it to the Right Joystick Sources, to be committed by the caller.
+ * Returns true if changed.
+ */
+static inline bool route_Joystick_Right(void)
+{
+    Joystick_Value joyRight = Joystick_Right;
+
+    if (KeyJoy_Right)
+        joyRight = KeyJoy_Merge(joyRight);
+
+    if (joyRight == Joystick_Routed[1])
+        return false;
+
+    Route_Joystick(ROUTE_JOYR, joyRight);
+    Joystick_Routed[1] = joyRight;
+    return true;
+}
+
+/*
+ * process_Joysticks routes both Joysticks' current inputs, and commits the
+ * switch changes of both (if any) together, in the one pass.
+ */
+static inline void process_Joysticks(void)
+{
+    MT8816_Own();
+    if (route_Joystick_Left() | route_Joystick_Right())
+        Route_Commit();
+    MT8816_Release();
+}
+
+#ifdef JOYSTICK_FAST_PATH
+/*
+ * Route_Commit_Joysticks routes both Joysticks' current inputs, and commits
+ * only the crosspoints their changes affect (the Joystick ISR fast path, so
+ * the MT8816 MUST NOT be owned by the main loop). Each Joystick's new
+ * crosspoints are looked up from the precalculated masks, and only the
+ * bytes where a Joystick's crosspoints differ from the last commit are
+ * compared with the shadow state, so there is no full Route_Target pass.
+ * A crosspoint is switched Off only if no other active Source (keyboard
+ * key, or the other Joystick) still holds it. Route_Pending isn't touched.
+ */
+static void Route_Commit_Joysticks(void)
+{
+    Crosspoint_Mask side[2];
+    uint8_t switchOff[MT8816_CROSSPOINTS];
+    uint8_t switchOn[MT8816_CROSSPOINTS];
+    uint8_t switchOffCount = 0;
+    uint8_t switchOnCount = 0;
+
+    if (!(route_Joystick_Left() | route_Joystick_Right()))
+        return;
+
+    for(uint8_t lp = 0; lp < 2; lp++ )
+    {
+        Joystick_Value joyValue = Joystick_Routed[lp];
+        uint8_t buttons = (uint8_t)(joyValue >> 4);
+
+        side[lp].all = Route_Fast_Directions[lp][joyValue & 0x0F] |
+                       Route_Fast_Buttons[lp][0][buttons & 0x0F] |
+                       Route_Fast_Buttons[lp][1][buttons >> 4];
+    }
+
+    for(uint8_t lp1 = 0; lp1 < sizeof(MT8816_Shadow); lp1++ )
+    {
+        uint8_t changed = (side[0].bytes[lp1] ^ Route_Fast_Side[0].bytes[lp1]) |
+                          (side[1].bytes[lp1] ^ Route_Fast_Side[1].bytes[lp1]);
+
+        if (changed == 0)
+            continue;
+
+        uint8_t target = Route_Fast_Rest.bytes[lp1] | side[0].bytes[lp1] |
+                         side[1].bytes[lp1];
+
+        changed &= target ^ MT8816_Shadow[lp1];
+
+        for(uint8_t lp2 = 0; changed; lp2++, changed >>= 1 )
+            if (changed & 0x01)
+            {
+                if (target & Crosspoint_bm[lp2])
+                    switchOn[switchOnCount++] = (lp1 << 3) | lp2;
+                else
+                    switchOff[switchOffCount++] = (lp1 << 3) | lp2;
+            }
+    }
+
+    Route_Fast_Side[0] = side[0];
+    Route_Fast_Side[1] = side[1];
+    Route_Switch(switchOff, switchOffCount, switchOn, switchOnCount);
+}
+#endif
+
+#ifndef PS2_MOUSE
+/*
+ * process_KeyJoy_ScanCode handles a key press / release ScanCode while in
+ * Keyboard Joystick mode. Returns true if the key is a Keyboard Joystick key.
+ * The Joystick is processed straight away, so a key edge reaches the
+ * crosspoints via the same path (and latency) as an Atari Joystick edge.
+ */
+static bool process_KeyJoy_ScanCode(uint16_t keyCode, bool key_release)
+{
+    uint8_t key = KeyJoy_Key(keyCode);
+
+    if (key == KEYJOY_KEYS)
+        return false;
+
+    if (key_release)
+        KeyJoy_Held &= ~(1 << key);
+    else
+        KeyJoy_Held |= (1 << key);
+
+    /* Combine all held keys (e.g. for diagonals) */
+    uint8_t joystick = 0;
+    for(key = 0; key < KEYJOY_KEYS; key++ )
+        if (KeyJoy_Held & (1 << key))
+            joystick |= KeyJoy_Bits[key];
+
+    KeyJoy_Joystick = joystick;
+    process_Joysticks();
+
+    return true;
+}
+
+/*
+ * KeyJoy_Release_All releases any Keyboard Joystick switches that are On
+ */
+static void KeyJoy_Release_All(void)
+{
+    KeyJoy_Held = 0;
+    KeyJoy_Joystick = 0;
+    process_Joysticks();
+}
+
+/*
+ * Keyboard_Recover releases all keyboard key and Keyboard Joystick Sources,
+ * as an error recovery. Route_Commit switches Off only the crosspoints they
+ * alone held, so a held Joystick direction or button stays On throughout.
+ */
+static void Keyboard_Recover(void)
+{
+    MT8816_Own();
+    Keyboard_Release_All();
+    KeyJoy_Release_All();
+    MT8816_Release();
+}
+
+/*
+ * toggle_KeyJoy turns Keyboard Joystick mode On or Off
+ * NOTE: A key held across the toggle would have its release decoded by the
+ *       other path (e.g. keypad '8' pressed as a key, released as Joystick
+ *       Up), and stay stuck On. So all keys and Keyboard Joystick switches
+ *       are released on every toggle.
+ */
+static void toggle_KeyJoy(void)
+{
+    KeyJoy_Enabled = !KeyJoy_Enabled;
+
+    MT8816_Own();
+    Keyboard_Release_All();
+    KeyJoy_Release_All();
+    MT8816_Release();
+}
+#endif
+
+/* 
+ * get_PS2_ScanCode gets a Scan Code byte from the PS2_ScanCodeBuffer
+ * Returns 0 if Buffer is empty
+ * Atomic block is defined to ensure no interrupt occurs (buffer change),
+ * while we are extracting a ScanCode from the buffer!
+ */
+static inline uint8_t get_PS2_ScanCode(void)
+{
+	uint8_t value;
+
+	ATOMIC_BLOCK(ATOMIC_FORCEON) 
+    {
+		if (PS2_ScanCodeBuffer_Start == PS2_ScanCodeBuffer_End)
+			return 0;
+
+		value = PS2_ScanCodeBuffer[PS2_ScanCodeBuffer_Start];
+        
+		if (++PS2_ScanCodeBuffer_Start == PS2_ScanCodeBuffer_Size)
+			PS2_ScanCodeBuffer_Start = 0;
+	}
+	return value;
+}
+
+/*
+ * PS2_ScanCodes_Waiting returns the count of buffered ScanCodes
+ * NOTE: Call with interrupts off (or from the PS/2 ISR)
+ */
+static inline uint8_t PS2_ScanCodes_Waiting(void)
+{
+    uint8_t waiting = PS2_ScanCodeBuffer_End - PS2_ScanCodeBuffer_Start;
+
+    if (PS2_ScanCodeBuffer_End < PS2_ScanCodeBuffer_Start)
+        waiting += PS2_ScanCodeBuffer_Size;
+    return waiting;
+}
+
+#ifndef PS2_MOUSE
+/*
+ * PS/2 (Scan Code Set 2) multi-byte sequence states
+ * Each prefix has its own state, held only until the sequence completes:
+ *  F0       - key release
+ *  E0       - extended key press
+ *  E0 F0    - extended key release
+ *  E1 ...   - 'PAUSE' key (E1 14 77 E1 F0 14 F0 77, make & break together)
+ */
+#define PS2_STATE_IDLE             0
+#define PS2_STATE_RELEASE          1
+#define PS2_STATE_EXTENDED         2
+#define PS2_STATE_EXTENDED_RELEASE 3
+#define PS2_STATE_PAUSE            4
+
+#define PS2_PAUSE_LENGTH 8 /* E1 14 77 E1 F0 14 F0 77 */
+
+/*
+ * decode_PS2_Key turns On or Off CreatiVision switches for a complete
+ * (i.e. prefixes already decoded) key press or release.
+ */
+static void decode_PS2_Key(uint8_t scanCode, bool extended, bool key_release)
+{
+	static bool numLock_held = false;
+	static bool scrollLock_held = false;
+
+/*
+ * 'NUM LOCK' key press toggles Keyboard Joystick mode
+ * (once per press, i.e. ignoring typematic repeats)
+ */
+    if ((scanCode == 0x77) && !extended)
+    {
+        if (key_release)
+            numLock_held = false;
+        else if (!numLock_held)
+        {
+            numLock_held = true;
+            toggle_KeyJoy();
+        }
+        return;
+    }
+
+/*
+ * 'SCROLL LOCK' + 'F1' ... 'F4' hotkey chord selects a Route Profile
+ */
+    if ((scanCode == 0x7E) && !extended)
+    {
+        scrollLock_held = !key_release;
+        return;
+    }
+
+    if (scrollLock_held && !key_release && !extended)
+    {
+        switch (scanCode)
+        {
+            case 0x05: /* 'F1' key */
+                Route_Profile_Select(0, true);
+                return;
+
+            case 0x06: /* 'F2' key */
+                Route_Profile_Select(1, true);
+                return;
+
+            case 0x04: /* 'F3' key */
+                Route_Profile_Select(2, true);
+                return;
+
+            case 0x0C: /* 'F4' key */
+                Route_Profile_Select(3, true);
+                return;
+        }
+    }
+
+/*
+ * In Keyboard Joystick mode, Joystick keys are processed as a Joystick
+ */
+    if (KeyJoy_Enabled && 
+        process_KeyJoy_ScanCode(extended ? (0xE000 | scanCode) : scanCode,
+                                key_release))
+        return;
+
+/*
+ * Then look up the ScanCode's Route Source in the PS/2 Keymap, and update
+ * the key press (or release), to be committed at the end of the batch.
+ * Just ignore ScanCodes of no interest to us!
+ */
+    if (scanCode < 0x80)
+    {
+        uint8_t source = PS2_Keymap[extended][scanCode];
+
+        if (source != ROUTE_NONE)
+        {
+            Route_Update_Deferred(source, !key_release);
+            return;
+        }
+    }
+    Health.ps2_UnknownScanCodes++;
+}
+
+/*
+ * decode_PS2_ScanCode decodes each ScanCode byte, through the multi-byte
+ * sequence states above, to complete key presses and releases.
+ * 
+ * NOTE: A prefix state is only held until the very next non-prefix ScanCode,
+ *       whether or not it is of interest to us, so a stray prefix can never
+ *       leak into the next key. Sequences which aren't keys at all are
+ *       swallowed whole, with no crosspoint activity:
+ *        - 'PAUSE' (E1 ...), which would otherwise look like a 'CTRL' and
+ *          'NUM LOCK' press and release,
+ *        - the fake shifts (E0 12, E0 59, and their E0 F0 releases) sent
+ *          around 'PRINT SCREEN', and other E0 keys when 'NUM LOCK' or
+ *          'SHIFT' are on, which must never reach the console as 'SHIFT'.
+ */
+static void decode_PS2_ScanCode(uint8_t scanCode)
+{
+	static uint8_t state = PS2_STATE_IDLE;
+	static uint8_t pause_remaining = 0;
+
+/*
+ * Stuck key recovery requested? Release all Keyboard crosspoints, and
+ * restart ScanCode decoding from a clean state.
+ */
+    if (PS2_Recovery_Request)
+    {
+        PS2_Recovery_Request = false;
+        state = PS2_STATE_IDLE;
+        Keyboard_Recover();
+        Health.ps2_Recoveries++;
+    }
+
+    if (scanCode == 0)
+        return;
+
+/*
+ * Keyboard BAT (reset or hot-plugged) restarts decoding, in any state
+ */
+    if ((scanCode == 0xAA) || (scanCode == 0xFC))
+    {
+        state = PS2_STATE_IDLE;
+        Keyboard_Recover();
+        Health.ps2_Recoveries++;
+        return;
+    }
+
+    switch (state)
+    {
+        case PS2_STATE_PAUSE:
+            if (--pause_remaining == 0)
+                state = PS2_STATE_IDLE;
+            return;
+
+        case PS2_STATE_IDLE:
+        case PS2_STATE_EXTENDED:
+            if (scanCode == 0xF0)
+            {
+                state = (state == PS2_STATE_EXTENDED) ? PS2_STATE_EXTENDED_RELEASE
+                                                      : PS2_STATE_RELEASE;
+                return;
+            }
+            break;
+    }
+
+    if (scanCode == 0xE0)
+    {
+        state = PS2_STATE_EXTENDED;
+        return;
+    }
+
+    if (scanCode == 0xE1)
+    {
+        state = PS2_STATE_PAUSE;
+        pause_remaining = PS2_PAUSE_LENGTH - 1;
+        return;
+    }
+
+    /* A non-prefix ScanCode always completes the sequence */
+    bool extended = (state == PS2_STATE_EXTENDED) || 
+                    (state == PS2_STATE_EXTENDED_RELEASE);
+    bool key_release = (state == PS2_STATE_RELEASE) || 
+                       (state == PS2_STATE_EXTENDED_RELEASE);
+    state = PS2_STATE_IDLE;
+
+    /* Fake shifts are not keys */
+    if (extended && ((scanCode == 0x12) || (scanCode == 0x59)))
+        return;
+
+    decode_PS2_Key(scanCode, extended, key_release);
+}                                               
+#endif
+
+/*
+ * peek_PS2_ScanCode_Time gets the timestamp of the next buffered ScanCode.
+ * Returns false if Buffer is empty
+ */
+static inline bool peek_PS2_ScanCode_Time(uint16_t *time)
+{
+	ATOMIC_BLOCK(ATOMIC_FORCEON) 
+    {
+		if (PS2_ScanCodeBuffer_Start == PS2_ScanCodeBuffer_End)
+			return false;
+
+		*time = PS2_ScanCodeTime[PS2_ScanCodeBuffer_Start];
+	}
+	return true;
+}
+
+/*
+ * peek_Joystick_Event_Time gets the timestamp of the next buffered Joystick
+ * input event. Returns false if Buffer is empty
+ */
+static inline bool peek_Joystick_Event_Time(uint16_t *time)
+{
+	ATOMIC_BLOCK(ATOMIC_FORCEON) 
+    {
+		if (Joystick_EventBuffer_Start == Joystick_EventBuffer_End)
+			return false;
+
+		*time = Joystick_EventBuffer[Joystick_EventBuffer_Start].time;
+	}
+	return true;
+}
+
+/*
+ * process_Joystick_Event takes the next buffered Joystick input event (if
+ * any) as the current Joystick inputs, and processes both Joysticks.
+ */
+static void process_Joystick_Event(void)
+{
+    uint16_t time;
+    uint16_t latency;
+
+	ATOMIC_BLOCK(ATOMIC_FORCEON) 
+    {
+		if (Joystick_EventBuffer_Start == Joystick_EventBuffer_End)
+			return;
+
+        MT8816_Own();
+		time = Joystick_EventBuffer[Joystick_EventBuffer_Start].time;
+		Joystick_Left = Joystick_EventBuffer[Joystick_EventBuffer_Start].joyLeft;
+		Joystick_Right = Joystick_EventBuffer[Joystick_EventBuffer_Start].joyRight;
+
+		if (++Joystick_EventBuffer_Start == Joystick_EventBuffer_Size)
+			Joystick_EventBuffer_Start = 0;
+	}
+
+    process_Joysticks();
+    MT8816_Release();
+
+    /* Capture (e.g. pin change, or ADC conversion) to crosspoints latency */
+    latency = Timebase_Now() - time;
+    if (latency > Health.joystick_LatencyMax)
+        Health.joystick_LatencyMax = latency;
+}
+
+/*
+ * Input event ordering
+ * The next Joystick event and the next PS/2 ScanCode are processed in the
+ * order they were captured. So the console sees inputs in the order they
+ * actually happened, whatever the input, and a Joystick change never waits
+ * behind later ScanCodes.
+ * 
+ * ready_Joystick_Event is true if a Joystick event is next (since = capture)
+ */
+static bool ready_Joystick_Event(uint16_t *since)
+{
+    uint16_t ps2Time;
+
+    return peek_Joystick_Event_Time(since) && 
+        (!peek_PS2_ScanCode_Time(&ps2Time) || Timebase_Before(*since, ps2Time));
+}
+
+/*
+ * ready_PS2_ScanCode is true if a PS/2 ScanCode is next (since = capture),
+ * or a PS/2 stuck key recovery is requested (since = now).
+ */
+static bool ready_PS2_ScanCode(uint16_t *since)
+{
+    uint16_t joyTime;
+
+    if (PS2_Recovery_Request)
+    {
+        *since = Timebase_Now();
+        return true;
+    }
+
+    return peek_PS2_ScanCode_Time(since) && 
+        (!peek_Joystick_Event_Time(&joyTime) || !Timebase_Before(joyTime, *since));
+}
+
+#ifdef PS2_MOUSE
+/*
+ * PS/2 Mouse commands
+ * A mouse powers up (or resets, e.g. when hot-plugged) with data reporting
+ * disabled, so it is sent Enable Data Reporting (F4) until it acknowledges
+ * (FA), retrying every MOUSE_RETRY_ms. The Mouse Task and the PS/2 ISR send
+ * it between them, with no waiting, through the states:
+ *  MOUSE_DISABLED - not reporting, so send F4 (at Mouse_Time),
+ *  MOUSE_INHIBIT  - Clock held low (Request-to-Send), until Mouse_Time
+ *                   (over 100us),
+ *  MOUSE_WAIT_ACK - Data low (start bit) and Clock released, so the mouse
+ *                   clocks the frame out of the PS/2 ISR, and replies FA
+ *                   (by Mouse_Time, or the frame is abandoned and resent),
+ *  MOUSE_ENABLED  - reporting, so assembling movement packets.
+ * A BAT (AA 00, i.e. the mouse reset or hot-plugged) disables reporting
+ * again, but AA 00 is also a valid start of a movement packet. So it is only
+ * taken as a BAT (Mouse_BAT) if nothing follows it within MOUSE_BAT_TICKS,
+ * as a packet's 3rd byte always would (a BAT'd mouse sends nothing more).
+ */
+#define MOUSE_DISABLED 0
+#define MOUSE_INHIBIT  1
+#define MOUSE_WAIT_ACK 2
+#define MOUSE_ENABLED  3
+
+#define MOUSE_INHIBIT_TICKS (TICKS_FROM_US(100) + 1)
+#define MOUSE_RETRY_TICKS TICKS_FROM_US(MOUSE_RETRY_ms * 1000UL)
+#define MOUSE_BAT_TICKS TICKS_FROM_US(5000)
+
+#if MOUSE_RETRY_TICKS > 0x7FFF
+#error "MOUSE_RETRY_ms is too long for the Timebase"
+#endif
+
+#if (MOUSE_SLOTS > 255) || (MOUSE_HOLD_SLOTS > 255)
+#error "MOUSE_SLOTS and MOUSE_HOLD_SLOTS must fit in a byte"
+#endif
+
+static uint8_t Mouse_State = MOUSE_DISABLED;
+static uint16_t Mouse_Time;
+static bool Mouse_BAT = false;
+
+/*
+ * PS2_Command_Frame returns a command byte's frame, as the PS/2 ISR sends
+ * it: data (bit 0 - 7), odd parity, stop (1), and the marker bit.
+ */
+static inline uint16_t PS2_Command_Frame(uint8_t command)
+{
+    uint16_t frame = command | (1 << 9) | (1 << 10);
+
+    if (!__builtin_parity(command))
+        frame |= (1 << 8);
+    return frame;
+}
+
+/*
+ * ready_Mouse_Command is true once Mouse_Time is due (since = Mouse_Time),
+ * for a command, or to confirm a possible BAT. Any buffered byte is decoded
+ * first (the PS/2 Task comes first in Scheduler_Tasks).
+ */
+static bool ready_Mouse_Command(uint16_t *since)
+{
+    *since = Mouse_Time;
+
+    return ((Mouse_State != MOUSE_ENABLED) || Mouse_BAT) &&
+        !Timebase_Before(Timebase_Now(), Mouse_Time);
+}
+
+static void process_Mouse_Command(void)
+{
+    switch (Mouse_State)
+    {
+        case MOUSE_WAIT_ACK:
+            /* No acknowledge (e.g. no mouse yet), so abandon the frame */
+        	ATOMIC_BLOCK(ATOMIC_FORCEON) 
+            {
+                PS2_Transmitting = false;
+                VPORTF.DIR &= ~PS2_Data_bm;
+            }
+            /* fall through */
+
+        case MOUSE_DISABLED:
+            /* Request-to-Send (unless flow control has the Clock just now) */
+        	ATOMIC_BLOCK(ATOMIC_FORCEON) 
+            {
+                if (PS2_Inhibited)
+                    return;
+                PS2_Inhibited = true;
+                VPORTF.DIR |= PS2_Clock_bm;
+            }
+            Mouse_State = MOUSE_INHIBIT;
+            Mouse_Time = Timebase_Now() + MOUSE_INHIBIT_TICKS;
+            break;
+
+        case MOUSE_INHIBIT:
+            /* Start bit, then release the Clock for the mouse to send on */
+        	ATOMIC_BLOCK(ATOMIC_FORCEON) 
+            {
+                PS2_Transmit_Frame = PS2_Command_Frame(0xF4);
+                PS2_Transmitting = true;
+                VPORTF.DIR |= PS2_Data_bm;
+                PS2_Inhibited = false;
+                VPORTF.DIR &= ~PS2_Clock_bm;
+            }
+            Mouse_State = MOUSE_WAIT_ACK;
+            Mouse_Time = Timebase_Now() + MOUSE_RETRY_TICKS;
+            break;
+
+        case MOUSE_ENABLED:
+            /* Nothing followed AA 00, so it was a BAT */
+            Mouse_BAT = false;
+            Mouse_State = MOUSE_DISABLED;
+            Mouse_Time = Timebase_Now();
+        	ATOMIC_BLOCK(ATOMIC_FORCEON) 
+            {
+                Mouse.buttons = 0;
+                Mouse.hold = 0;
+            }
+            Health.ps2_Recoveries++;
+            break;
+    }
+}
+
+/*
+ * Mouse_Duty returns an axis' duty (On slots per modulator period) for its
+ * 9-bit movement (move, with the sign bit), or a full period on overflow.
+ */
+static inline uint8_t Mouse_Duty(uint8_t move, bool negative, bool overflow)
+{
+    uint16_t speed = negative ? (256 - move) : move;
+
+    if (overflow || (speed >= ((MOUSE_SLOTS + MOUSE_GAIN - 1) / MOUSE_GAIN)))
+        return MOUSE_SLOTS;
+    return speed * MOUSE_GAIN;
+}
+
+/*
+ * decode_PS2_Mouse decodes the next mouse byte (if any), i.e. the F4
+ * acknowledge (FA), and then the 3 byte movement packets:
+ *  byte 0 - Y overflow, X overflow, Y sign, X sign, 1, Middle, Right, Left,
+ *  byte 1 - X movement (with the X sign, + is Right),
+ *  byte 2 - Y movement (with the Y sign, + is Up).
+ * Packets are kept in step by the always 1 bit (bit 3) of byte 0. A packet
+ * starting AA 00 may be a BAT instead, so it waits on its 3rd byte (see
+ * Mouse_BAT).
+ */
+static void decode_PS2_Mouse(void)
+{
+    static uint8_t packet[3];
+    static uint8_t count = 0;
+    uint8_t waiting;
+    uint8_t data;
+    uint8_t buttons = 0;
+    uint8_t dutyX, dutyY;
+
+/*
+ * A lost byte (or a flushed Buffer) means the packet can't be trusted, so
+ * start again from the next packet.
+ */
+    if (PS2_Recovery_Request)
+    {
+        PS2_Recovery_Request = false;
+        count = 0;
+        Mouse_BAT = false;
+        Health.ps2_Recoveries++;
+    }
+
+	ATOMIC_BLOCK(ATOMIC_FORCEON) 
+    {
+        waiting = PS2_ScanCodes_Waiting();
+    }
+    if (waiting == 0)
+        return;
+
+    data = get_PS2_ScanCode();
+    Mouse_BAT = false;
+
+    if (Mouse_State != MOUSE_ENABLED)
+    {
+        if ((data == 0xFA) && (Mouse_State == MOUSE_WAIT_ACK))
+        {
+            Mouse_State = MOUSE_ENABLED;
+            count = 0;
+        }
+        return;
+    }
+
+    if ((count == 0) && !(data & 0x08))
+        return;
+
+    packet[count] = data;
+    if ((++count == 2) && (packet[0] == 0xAA) && (packet[1] == 0x00))
+    {
+        Mouse_BAT = true;
+        Mouse_Time = Timebase_Now() + MOUSE_BAT_TICKS;
+        return;
+    }
+
+    if (count < 3)
+        return;
+    count = 0;
+
+    if (packet[0] & 0x01)
+        buttons |= 0x10;                        /* Left = Button 1 */
+    if (packet[0] & 0x02)
+        buttons |= 0x20;                        /* Right = Button 2 */
+    dutyX = Mouse_Duty(packet[1], packet[0] & 0x10, packet[0] & 0x40);
+    dutyY = Mouse_Duty(packet[2], packet[0] & 0x20, packet[0] & 0x80);
+
+	ATOMIC_BLOCK(ATOMIC_FORCEON) 
+    {
+        Mouse.dirX = (packet[0] & 0x10) ? 0x04 : 0x08;
+        Mouse.dutyX = dutyX;
+        Mouse.dirY = (packet[0] & 0x20) ? 0x02 : 0x01;
+        Mouse.dutyY = dutyY;
+        Mouse.buttons = buttons;
+        Mouse.hold = MOUSE_HOLD_SLOTS;
+    }
+}
+#endif
+
+/*
+ * process_PS2_ScanCode decodes all buffered ScanCodes (if any), up to
+ * PS2_SCANCODE_BATCH per run, and then commits the resulting switch changes
+ * together. So a typical 2 or 3 byte key release (or a typing burst) needs
+ * just the one run, and one commit.
+ * The batch also ends at the next ScanCode captured after a buffered Joystick
+ * event, so the input event order is kept.
+ * The MT8816 is owned for the whole batch, as its Route updates are only
+ * committed at the end (Route_Pending), so a fast path Joystick commit
+ * can't land in the middle of them.
+ * NOTE: PS2_SCANCODE_BATCH should be at least 3 (i.e. E0 F0 nn), and is
+ *       bounded by the PS/2 Task budget.
+ */
+#define PS2_SCANCODE_BATCH 8
+
+static void process_PS2_ScanCode(void)
+{
+    uint16_t since;
+    uint8_t count = 0;
+    uint8_t waiting;
+
+    /* The Buffer only grows between runs, so its peak is seen right here */
+	ATOMIC_BLOCK(ATOMIC_FORCEON) 
+    {
+        waiting = PS2_ScanCodes_Waiting();
+    }
+    if (waiting > Health.ps2_QueueHighWater)
+        Health.ps2_QueueHighWater = waiting;
+
+    MT8816_Own();
+    do
+#ifdef PS2_MOUSE
+        decode_PS2_Mouse();
+#else
+        decode_PS2_ScanCode(get_PS2_ScanCode());
+#endif
+    while ((++count < PS2_SCANCODE_BATCH) && ready_PS2_ScanCode(&since));
+
+    Route_Commit_Pending();
+    MT8816_Release();
+
+    /* Release the keyboard, once drained below the low water mark */
+#ifdef PS2_MOUSE
+    if (PS2_Inhibited && (Mouse_State != MOUSE_INHIBIT))
+#else
+    if (PS2_Inhibited)
+#endif
+        ATOMIC_BLOCK(ATOMIC_FORCEON) 
+        {
+            if (PS2_ScanCodes_Waiting() < PS2_BUFFER_LOW_WATER)
+            {
+                VPORTF.DIR &= ~PS2_Clock_bm;
+                PS2_Inhibited = false;
+            }
+        }
+
+#ifdef CONTROLLER_CHECK_INVARIANTS
+    check_Crosspoint_Invariants();
+#endif
+}
+
+/* When the Hot counters were last folded (or seen with nothing to fold) */
+static uint16_t Health_Fold_Time;
+
+/*
+ * ready_Health_Fold is true if any Hot counters need folding into totals
+ * (since = when there was last nothing to fold, so a fold held off by
+ * busier Tasks, as the Hot counters fill, does miss its deadline)
+ */
+static bool ready_Health_Fold(uint16_t *since)
+{
+    bool pending = (Health_Hot.ps2_Frames | Health_Hot.ps2_FrameErrors |
+            Health_Hot.ps2_Overflows | Health_Hot.ps2_Inhibits |
+            Health_Hot.joystick_Events | Health_Hot.analog_Samples |
+            Health_Hot.pad_Polls | Health_Hot.joystick_FastCommits |
+            Health_Hot.mt8816_Strobes | Health_Hot.mt8816_Coalesced) != 0;
+
+#ifdef PS2_CLOCK_FILTER
+    if (TCB0.CNT != (uint16_t)Health.ps2_ClockEdges)
+        pending = true;
+#endif
+
+    if (!pending)
+        Health_Fold_Time = Timebase_Now();
+    *since = Health_Fold_Time;
+    return pending;
+}
+
 /*
- * Just ignore all other key ScanCodes that aren't of interest to us!
- * But, we still need to clear the flags (for any other key)
+ * Health_Take returns a Hot counter's count and clears it, atomically.
+ * Each counter is taken in its own short atomic section (a load and a
+ * store), so the fold never holds off the PS/2 ISR for long.
  */
-            default:
-                key_release = 0;
-                extended = 0;
-        }
-        
-/* 
- * Did we have a key press (or release) ScanCode of interest?
+static inline uint8_t Health_Take(volatile uint8_t *counter)
+{
+    uint8_t count;
+
+	ATOMIC_BLOCK(ATOMIC_FORCEON) 
+    {
+        count = *counter;
+        *counter = 0;
+    }
+    return count;
+}
+
+/*
+ * Health_Fold folds the Hot counters into the Health counter totals
+ */
+static void Health_Fold(void)
+{
+    Health_Hot_Counters hot;
+
+    hot.ps2_Frames = Health_Take(&Health_Hot.ps2_Frames);
+    hot.ps2_FrameErrors = Health_Take(&Health_Hot.ps2_FrameErrors);
+    hot.ps2_Overflows = Health_Take(&Health_Hot.ps2_Overflows);
+    hot.ps2_Inhibits = Health_Take(&Health_Hot.ps2_Inhibits);
+    hot.joystick_Events = Health_Take(&Health_Hot.joystick_Events);
+    hot.analog_Samples = Health_Take(&Health_Hot.analog_Samples);
+    hot.pad_Polls = Health_Take(&Health_Hot.pad_Polls);
+    hot.joystick_FastCommits = Health_Take(&Health_Hot.joystick_FastCommits);
+    hot.mt8816_Strobes = Health_Take(&Health_Hot.mt8816_Strobes);
+    hot.mt8816_Coalesced = Health_Take(&Health_Hot.mt8816_Coalesced);
+
+    Health.ps2_Frames += hot.ps2_Frames;
+    Health.ps2_FrameErrors += hot.ps2_FrameErrors;
+    Health.ps2_Overflows += hot.ps2_Overflows;
+    Health.ps2_Inhibits += hot.ps2_Inhibits;
+
+#ifdef PS2_CLOCK_FILTER
+    /*
+     * TCB0 / TCB1 count raw / filtered Clock pulses (16-bit, wrapping), so
+     * glitches = raw - filtered. A pulse still inside the filter may count
+     * here as a glitch, but it is counted out again by the next fold.
+     */
+    static uint32_t clockFiltered = 0;
+    uint16_t raw = TCB0.CNT;
+    uint16_t filtered = TCB1.CNT;
+
+    Health.ps2_ClockEdges += (uint16_t)(raw - (uint16_t)Health.ps2_ClockEdges);
+    clockFiltered += (uint16_t)(filtered - (uint16_t)clockFiltered);
+    Health.ps2_ClockGlitches = Health.ps2_ClockEdges - clockFiltered;
+#endif
+    Health.joystick_Events += hot.joystick_Events;
+    Health.analog_Samples += hot.analog_Samples;
+    Health.pad_Polls += hot.pad_Polls;
+    Health.joystick_FastCommits += hot.joystick_FastCommits;
+
+    /* The Joystick ISR counts MT8816 writes too, but never while owned */
+    MT8816_Own();
+    Health.mt8816_Writes += hot.mt8816_Strobes;
+    Health.mt8816_Coalesced += hot.mt8816_Coalesced;
+    MT8816_Release();
+
+    Health_Fold_Time = Timebase_Now();
+}
+
+#ifdef TELEMETRY_USART
+/*
+ * Telemetry output
+ * Every TELEMETRY_PERIOD_ms the Health counters are formatted (in hex) as
+ * one line of text, which is then sent a byte per Task run (i.e. only when
+ * the USART can take the next byte, so the Task never waits):
+ *  F=Frames E=FrameErrors O=Overflows I=Inhibits H=QueueHighWater
+ *  U=UnknownScanCodes R=Recoveries W=MT8816Writes S=Suppressed
+ *  J=JoystickEvents L=JoystickLatencyMax (Timebase ticks)
+ *  D=DeadlineMisses B=BudgetOverruns (all Scheduler Tasks)
+ *  (and G=ClockGlitches, with PS2_CLOCK_FILTER, A=AnalogSamples, with
+ *  JOYSTICK_MODE_ANALOG, i.e. the ADC sample rate, from line to line, and
+ *  P=PadPolls, with JOYSTICK_MODE_SNES / _SEGA, i.e. the pad poll rate,
+ *  K=FastCommits, with JOYSTICK_FAST_PATH, i.e. J events not buffered,
+ *  and C=Coalesced Q=QueueHighWater, with MT8816_WRITE_QUEUE)
+ */
+#define TELEMETRY_PERIOD TICKS_FROM_US(TELEMETRY_PERIOD_ms * 1000UL)
+
+static char Telemetry_Line[176];
+static uint8_t Telemetry_Length = 0;
+static uint8_t Telemetry_Sent = 0;
+static uint16_t Telemetry_Time = 0;
+
+static char *Telemetry_Hex(char *line, char name, uint32_t value, uint8_t digits)
+{
+    *line++ = name;
+    *line++ = '=';
+    while (digits--)
+        *line++ = "0123456789ABCDEF"[(value >> (digits * 4)) & 0x0F];
+    *line++ = ' ';
+    return line;
+}
+
+/*
+ * ready_Telemetry is true if the next line byte can be sent, or the next
+ * line is due
+ */
+static bool ready_Telemetry(uint16_t *since)
+{
+    if (Telemetry_Sent < Telemetry_Length)
+    {
+        *since = Timebase_Now();
+        return (TELEMETRY_USART.STATUS & USART_DREIF_bm) != 0;
+    }
+
+    *since = Telemetry_Time + TELEMETRY_PERIOD;
+    return !Timebase_Before(Timebase_Now(), *since);
+}
+
+static void process_Telemetry(void)
+{
+    if (Telemetry_Sent < Telemetry_Length)
+    {
+        TELEMETRY_USART.TXDATAL = Telemetry_Line[Telemetry_Sent++];
+        return;
+    }
+
+    Health_Fold();
+
+    /* (the fast path ISR updates W, S & K, so hold it off) */
+    MT8816_Own();
+    char *line = Telemetry_Line;
+    line = Telemetry_Hex(line, 'F', Health.ps2_Frames, 8);
+    line = Telemetry_Hex(line, 'E', Health.ps2_FrameErrors, 4);
+    line = Telemetry_Hex(line, 'O', Health.ps2_Overflows, 4);
+    line = Telemetry_Hex(line, 'I', Health.ps2_Inhibits, 4);
+    line = Telemetry_Hex(line, 'H', Health.ps2_QueueHighWater, 2);
+    line = Telemetry_Hex(line, 'U', Health.ps2_UnknownScanCodes, 4);
+    line = Telemetry_Hex(line, 'R', Health.ps2_Recoveries, 4);
+    line = Telemetry_Hex(line, 'W', Health.mt8816_Writes, 8);
+    line = Telemetry_Hex(line, 'S', Health.mt8816_Suppressed, 8);
+    line = Telemetry_Hex(line, 'J', Health.joystick_Events, 8);
+    line = Telemetry_Hex(line, 'L', Health.joystick_LatencyMax, 4);
+    line = Telemetry_Hex(line, 'D', Health.scheduler_DeadlineMisses, 4);
+    line = Telemetry_Hex(line, 'B', Health.scheduler_BudgetOverruns, 4);
+#ifdef PS2_CLOCK_FILTER
+    line = Telemetry_Hex(line, 'G', Health.ps2_ClockGlitches, 8);
+#endif
+#if JOYSTICK_LEFT_MODE == JOYSTICK_MODE_ANALOG
+    line = Telemetry_Hex(line, 'A', Health.analog_Samples, 8);
+#endif
+#if defined(SNES_PAD) || defined(SEGA_PAD)
+    line = Telemetry_Hex(line, 'P', Health.pad_Polls, 8);
+#endif
+#ifdef JOYSTICK_FAST_PATH
+    line = Telemetry_Hex(line, 'K', Health.joystick_FastCommits, 8);
+#endif
+#ifdef MT8816_WRITE_QUEUE
+    line = Telemetry_Hex(line, 'C', Health.mt8816_Coalesced, 4);
+    line = Telemetry_Hex(line, 'Q', Health.mt8816_QueueHighWater, 2);
+#endif
+    MT8816_Release();
+    *line++ = '\r';
+    *line++ = '\n';
+
+    Telemetry_Length = line - Telemetry_Line;
+    Telemetry_Sent = 0;
+    Telemetry_Time = Timebase_Now();
+}
+#endif
+
+/*
+ * Main loop Scheduler (cooperative, tickless)
+ * 
+ * Tasks are listed below in priority order. Each Scheduler pass runs the
+ * highest priority Task which is ready, and the next pass starts again from
+ * the top. So once ready, a Task waits at most for the one Task already
+ * running (i.e. the longest budget below) before it runs. 
+ * 
+ * Each Task declares, in Timebase ticks:
+ *  deadline - longest wait, from becoming ready (e.g. input captured) to run,
+ *  budget   - longest run time.
+ * Deadline misses and budget overruns are counted per Task, for inspection
+ * in the debugger, and in total in the Health counters (and Telemetry). Tasks MUST NOT block (i.e. split anything lengthy over
+ * several runs), and any new Task (e.g. telemetry) MUST be added below the
+ * input Tasks, with a budget that keeps their deadlines.
+ */
+typedef struct
+{
+    bool (*ready)(uint16_t *since); /* Ready to run? (and since when) */
+    void (*run)(void);
+    uint16_t deadline;
+    uint16_t budget;
+} Scheduler_Task;
+
+static const Scheduler_Task Scheduler_Tasks[] =
+{
+    /* Joystick events - Joystick to crosspoint latency */
+    { ready_Joystick_Event, process_Joystick_Event, 
+      TICKS_FROM_US(1000), TICKS_FROM_US(250) },
+
+    /* PS/2 ScanCode decode (batch) - keeps up with a ~1ms per byte keyboard */
+    { ready_PS2_ScanCode, process_PS2_ScanCode, 
+      TICKS_FROM_US(2000), TICKS_FROM_US(500) },
+
+#ifdef PS2_MOUSE
+    /* PS/2 Mouse commands - Request-to-Send held at least 100us */
+    { ready_Mouse_Command, process_Mouse_Command, 
+      TICKS_FROM_US(2000), TICKS_FROM_US(50) },
+#endif
+
+    /* Route Profile save - an EEPROM byte write, once the EEPROM is ready */
+    { ready_Profile_Save, process_Profile_Save, 
+      TICKS_FROM_US(50000), TICKS_FROM_US(50) },
+
+    /* Health counters fold - Hot counters well before they could wrap */
+    { ready_Health_Fold, Health_Fold, 
+      TICKS_FROM_US(50000), TICKS_FROM_US(50) },
+
+#ifdef TELEMETRY_USART
+    /* Telemetry output - a line per TELEMETRY_PERIOD_ms, a byte per run */
+    { ready_Telemetry, process_Telemetry, 
+      TICKS_FROM_US(100000), TICKS_FROM_US(250) },
+#endif
+};
+
+#define SCHEDULER_TASKS (sizeof(Scheduler_Tasks) / sizeof(Scheduler_Tasks[0]))
+
+static uint16_t Scheduler_Deadline_Miss[SCHEDULER_TASKS];
+static uint16_t Scheduler_Budget_Overrun[SCHEDULER_TASKS];
+
+/*
+ * Scheduler_Run runs the highest priority ready Task (if any)
  */
-        if ((switchValue_a != NO_SWITCH_ACTION) || (switchValue_b != NO_SWITCH_ACTION))
+static void Scheduler_Run(void)
+{
+    uint16_t since;
+    uint16_t start;
+
+    for(uint8_t task = 0; task < SCHEDULER_TASKS; task++ )
+        if (Scheduler_Tasks[task].ready(&since))
         {
-            if (switchValue_a != NO_SWITCH_ACTION)
-            {
-                if (key_release)
-                {
-                    MT8816_Switch(false, switchValue_a);
-                }
-                else
-                {
-                    MT8816_Switch(true, switchValue_a);
-                }    
-            }    
-            if (switchValue_b != NO_SWITCH_ACTION)
+            start = Timebase_Now();
+            if ((uint16_t)(start - since) > Scheduler_Tasks[task].deadline)
             {
-                if (key_release)
-                {
-                    MT8816_Switch(false, switchValue_b);
-                }    
-                else
-                {
-                    MT8816_Switch(true, switchValue_b);
-                }    
+                Scheduler_Deadline_Miss[task]++;
+                Health.scheduler_DeadlineMisses++;
             }
 
-            /* After a valid key press ScanCode, we can clear the flags! */
-            key_release = 0;
-            extended = 0;
+            Scheduler_Tasks[task].run();
+
+            if ((uint16_t)(Timebase_Now() - start) > Scheduler_Tasks[task].budget)
+            {
+                Scheduler_Budget_Overrun[task]++;
+                Health.scheduler_BudgetOverruns++;
+            }
+            return;
         }
-    }
-}                                               
+}
+
+/*
+ * Interrupt Priority
+ * The PS/2 Clock (PORTF, or CCL) interrupt is assigned Level 1 priority in
+ * CPUINT, so it preempts every other (Level 0) ISR, and a PS/2 Data bit is
+ * never lost to a Joystick (or any future timer / USART) ISR.
+ * 
+ * Each ISR's maximum execution time (CPU cycles, excluding any preemption
+ * by the PS/2 ISR) is documented here. These are manual estimates, read
+ * from the C code (not derived from the compiled code), so please confirm
+ * them with the MPLAB X Simulator Stopwatch after any change (make check
+ * in tools/isr_cycles checks JOYSTICK_ISR_MAX_CYCLES against the compiled
+ * PORTC / PORTD ISRs, without JOYSTICK_FAST_PATH):
+ *  PS2_Interrupt      - PS2_ISR_BUDGET_CYCLES (stop bit path, see below)
+ *  Joystick_Interrupt - JOYSTICK_ISR_MAX_CYCLES (MCC PORTC / PORTD ISR,
+ *                       calling back once per flagged pin, up to 8 pins),
+ *                       plus JOYSTICK_COMMIT_MAX_CYCLES for the one commit
+ *                       of a change, with JOYSTICK_FAST_PATH (and the same
+ *                       again in each ISR below which captures a change):
+ *                       routing ~120, mask lookups ~180, byte compare ~130,
+ *                       list & write overhead ~100, plus 4 crosspoints
+ *                       (a diagonal), each listed and Strobed
+ *  ADC0_RESRDY_vect   - ANALOG_ISR_MAX_CYCLES (JOYSTICK_MODE_ANALOG only,
+ *                       including the Joystick_Interrupt capture)
+ *  TCA0_CMP0_vect     - SNES_ISR_MAX_CYCLES (JOYSTICK_MODE_SNES only, an
+ *                       8 bit shift of both pads, and the capture)
+ *  TCA0_CMP1_vect     - SEGA_ISR_MAX_CYCLES (JOYSTICK_MODE_SEGA only, the
+ *                       Select sequence of both pads, and the capture)
+ *  TCA0_CMP2_vect     - MOUSE_ISR_MAX_CYCLES (PS2_MOUSE only, a modulator
+ *                       slot, and the capture)
+ *  TCB2_INT_vect      - DRAIN_ISR_MAX_CYCLES (MT8816_WRITE_QUEUE only, a
+ *                       full drain of MT8816_DRAIN_STROBES Strobes)
+ */
+#define JOYSTICK_ISR_MAX_CYCLES (60 + (8 * 45))
+#define JOYSTICK_COMMIT_MAX_CYCLES \
+    (530 + (4 * (15 + MT8816_STROBE_LOOP_CYCLES)))
+#define ANALOG_ISR_MAX_CYCLES (90 + 60)
+#define SNES_ISR_MAX_CYCLES (100 + (8 * (24 + (2 * SNES_HALF_CYCLES))) + 60)
+#define SEGA_ISR_MAX_CYCLES (120 + SEGA_SEQUENCE_CYCLES + 60)
+#define MOUSE_ISR_MAX_CYCLES (80 + 60)
+#define DRAIN_ISR_MAX_CYCLES (150 + (MT8816_DRAIN_STROBES * (30 + MT8816_STROBE_LOOP_CYCLES)))
+
+/*
+ * PS/2 ISR worst case latency (Clock falling edge to Data sampled)
+ * As Level 1, the PS/2 ISR can only be held off by code running with
+ * interrupts disabled (i.e. the ATOMIC_BLOCKs), so the worst case is the
+ * longest such section (ATOMIC_MAX_CYCLES), plus interrupt response and
+ * ISR entry. Every ATOMIC_BLOCK is covered by one of:
+ *  ATOMIC_STROBES_CYCLES - MT8816_SwitchList and TCB2 drain groups
+ *                          (MT8816_ATOMIC_STROBES Strobes), and
+ *                          MT8816_SwitchPair (2 Strobes),
+ *  ATOMIC_EVENT_CYCLES   - process_Joystick_Event's event copy (and
+ *                          MT8816_Own), the longest of the buffer sections:
+ *                          get_PS2_ScanCode, the ScanCode / Joystick event
+ *                          time peeks, the PS/2 waiting count and flow
+ *                          control release, Timebase_Now, Timebase_Schedule
+ *                          and the Health_Take of each Hot counter,
+ *  ATOMIC_MOUSE_CYCLES   - PS2_MOUSE only, the Mouse packet update and the
+ *                          command steps (Request-to-Send, start bit, the
+ *                          abandon, and the BAT button release).
+ * The start up Joystick capture (in main) is the only other interrupts
+ * disabled code, run once, long before the keyboard's power On BAT.
+ * Data MUST be sampled within the 30us minimum Clock low time (less 5us,
+ * as keyboards may change Data up to 5us before the Clock rises), so the
+ * build fails if this can't be guaranteed at the configured F_CPU.
+ * NOTE: This is a manual estimate. The cycle counts below are read from the
+ *       C code, not from the compiled code, so the check is only as good as
+ *       they are. The PS/2 ISR entry (to the Data sample) is measured
+ *       from the compiled code by make check in tools/isr_cycles (or
+ *       isr_cycles.py --entry), which fails if it exceeds
+ *       PS2_ISR_ENTRY_CYCLES below. The atomic sections aren't measured.
+ */
+#define INTERRUPT_RESPONSE_CYCLES 10 /* Response + longest instruction */
+
+#if defined(PS2_CLOCK_FILTER)
+#define PS2_ISR_ENTRY_CYCLES 13      /* CCL filter delay + own prologue */
+#elif defined(PS2_DIRECT_VECTOR)
+#define PS2_ISR_ENTRY_CYCLES 10      /* Own prologue, then Data sampled */
+#else
+#define PS2_ISR_ENTRY_CYCLES 40      /* MCC PORTF ISR + callback */
+#endif
+
+#define MT8816_STROBE_LOOP_CYCLES \
+    (8 + MT8816_SETUP_CYCLES + MT8816_STROBE_CYCLES + MT8816_HOLD_CYCLES)
+
+#define ATOMIC_STROBES_CYCLES (MT8816_ATOMIC_STROBES * MT8816_STROBE_LOOP_CYCLES)
+#define ATOMIC_EVENT_CYCLES 45
+
+#ifdef PS2_MOUSE
+#define ATOMIC_MOUSE_CYCLES 30
+#else
+#define ATOMIC_MOUSE_CYCLES 0
+#endif
+
+#define CYCLES_MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+#define ATOMIC_MAX_CYCLES CYCLES_MAX(ATOMIC_STROBES_CYCLES, \
+    CYCLES_MAX(ATOMIC_EVENT_CYCLES, ATOMIC_MOUSE_CYCLES))
+
+#define PS2_LATENCY_CYCLES \
+    (ATOMIC_MAX_CYCLES + INTERRUPT_RESPONSE_CYCLES + PS2_ISR_ENTRY_CYCLES)
+
+#define PS2_LATENCY_BUDGET_CYCLES CYCLES_FROM_NS(25000UL)
+
+#if PS2_LATENCY_CYCLES > PS2_LATENCY_BUDGET_CYCLES
+#error "PS/2 ISR worst case latency exceeds the PS/2 Data valid time"
+#endif
+
+#ifdef PS2_CLOCK_FILTER
+/*
+ * PS2_Clock_Filter_Initialize sets up the PS/2 Clock glitch filter:
+ *  CCL LUT3 IN0 = PF0 (IN1 & IN2 masked), output = IN0, via the filter
+ *  (clocked by CLK_PER), with an interrupt on the output falling edge.
+ *  Event Channel 4 = PF0 (raw), counted by TCB0.
+ *  Event Channel 5 = LUT3 output (filtered), counted by TCB1.
+ */
+static void PS2_Clock_Filter_Initialize(void)
+{
+    CCL.LUT3CTRLB = CCL_INSEL0_IO_gc | CCL_INSEL1_MASK_gc;
+    CCL.LUT3CTRLC = CCL_INSEL2_MASK_gc;
+    CCL.TRUTH3 = 0x02; /* Output = IN0 */
+    CCL.LUT3CTRLA = CCL_FILTSEL_FILTER_gc | CCL_CLKSRC_CLKPER_gc | CCL_ENABLE_bm;
+    CCL.INTCTRL0 = CCL_INTMODE3_FALLING_gc;
+    CCL.CTRLA = CCL_ENABLE_bm;
+
+    EVSYS.CHANNEL4 = EVSYS_CHANNEL4_PORTF_PIN0_gc;
+    EVSYS.CHANNEL5 = EVSYS_CHANNEL5_CCL_LUT3_gc;
+    EVSYS.USERTCB0COUNT = EVSYS_USER_CHANNEL4_gc;
+    EVSYS.USERTCB1COUNT = EVSYS_USER_CHANNEL5_gc;
+
+    TCB0.CCMP = 0xFFFF;
+    TCB0.CTRLB = TCB_CNTMODE_INT_gc;
+    TCB0.CTRLA = TCB_CLKSEL_EVENT_gc | TCB_ENABLE_bm;
+    TCB1.CCMP = 0xFFFF;
+    TCB1.CTRLB = TCB_CNTMODE_INT_gc;
+    TCB1.CTRLA = TCB_CLKSEL_EVENT_gc | TCB_ENABLE_bm;
+}
+#endif
 
 /*
  * PS2 Keyboard Input - INTERRUPT SERVICE ROUTINE!
  * Interrupt is called on falling edge of PS/2 Clock signal
+ * 
+ * Cycle budget: The PS/2 Clock runs at 10 - 16.7kHz, so a new edge can come
+ * every 60us, and Data is only guaranteed valid for the 30us Clock low time.
+ * So Data is sampled first (single cycle VPORTF read), and the per-bit paths
+ * are kept short (no per-bit parity count, no redundant bit clear). Only the
+ * final (stop) bit does the buffer write.
+ * PS2_ISR_BUDGET_CYCLES (half the Clock low time, allowing for interrupt
+ * latency) is the worst case allowed for the stop bit path, including the
+ * interrupt entry / exit. tools/isr_cycles/isr_cycles.py counts the
+ * compiled ISR's worst case path (from its disassembly) against it, and
+ * fails when it is exceeded (run it as an MPLAB X post build step, so the
+ * build fails too). Or run make check in tools/isr_cycles, which builds
+ * the firmware with avr-gcc and checks the Joystick pin change ISRs too.
+ */
+#define PS2_ISR_BUDGET_CYCLES CYCLES_FROM_NS(15000UL)
+
+/*
+ * 0x00 is a keyboard overrun, but a perfectly good mouse packet byte
  */
+#ifdef PS2_MOUSE
+#define PS2_DATA_VALID(data) true
+#else
+#define PS2_DATA_VALID(data) ((data) != 0x00)
+#endif
+
+#if defined(PS2_CLOCK_FILTER)
+ISR(CCL_CCL_vect)
+#elif defined(PS2_DIRECT_VECTOR)
+ISR(PORTF_PORT_vect)
+#else
 void PS2_Interrupt(void)
+#endif
 { 
+    uint8_t thisBit = VPORTF.IN & PS2_Data_bm;
+
 	static uint8_t startBit = 0;
 	static uint8_t data;
-    static uint8_t parityCount = 0;
-	static uint8_t stopBit = 0;
+    static uint8_t parity = 0;
 	static uint8_t bitCount = 0;
 
-    uint8_t thisBit = PORTF.IN & PS2_Data_bm;
+#if defined(PS2_CLOCK_FILTER)
+    CCL.INTFLAGS = CCL_INT3_bm;
+#elif defined(PS2_DIRECT_VECTOR)
+    VPORTF.INTFLAGS = PS2_Clock_bm;
+#endif
+
+    /* Ignore our own Clock edges, while the keyboard is inhibited */
+    if (PS2_Inhibited)
+        return;
+
+#ifdef PS2_MOUSE
+    /*
+     * Sending a command: set up the next frame bit (Data Output low for 0,
+     * released for 1) for the device to read on the Clock rising edge.
+     * Only the marker bit is left at the device's acknowledge bit (11th
+     * edge), so the frame is complete, and any frame we cut short by
+     * inhibiting is dropped too.
+     */
+    if (PS2_Transmitting)
+    {
+        uint16_t frame = PS2_Transmit_Frame;
+
+        if (frame == 0x0001)
+        {
+            PS2_Transmitting = false;
+            parity = 0;
+            bitCount = 0;
+            return;
+        }
+        if (frame & 0x0001)
+            VPORTF.DIR &= ~PS2_Data_bm;
+        else
+            VPORTF.DIR |= PS2_Data_bm;
+        PS2_Transmit_Frame = frame >> 1;
+        return;
+    }
+#endif
 
     bitCount++;
     switch (bitCount) 
     {
         case 1:
             startBit = thisBit;
-            break;
+            return;
 
         case 2 ... 9 :
     		data = data >> 1;      
         	if (thisBit)    /* read PS2_Data Pin */
-            {    
     			data = data | 0x80; /* Set bit (1) */
-                parityCount++;
-            }    
-            else
-    			data = data & 0x7f; /* Clear bit (0) */
-            break;
+            parity ^= thisBit;
+            return;
 
         case 10:
-    		if (thisBit)    /* read PS2_Data Pin */
-                parityCount++;
-            break;
-
-        case 11:
-            stopBit = thisBit;
-            break;
+            parity ^= thisBit;
+            return;
     }
 
-	if (bitCount > 10) 
+    /* 
+     * Stop bit, so all bits are now received. Check valid start, stop and
+     * (odd) parity bits, i.e. data + parity bits have an odd count of 1's.
+     */
+    if (parity && !(startBit) && (thisBit) && PS2_DATA_VALID(data))
     {
-		/* If all bits now received, check valid start, stop and parity bits */
-        if ((parityCount % 2) && !(startBit) && (stopBit))
+		/* If valid ScanCode, add to Buffer (timestamped) */
+        PS2_ScanCodeBuffer[PS2_ScanCodeBuffer_End] = data;
+        PS2_ScanCodeTime[PS2_ScanCodeBuffer_End] = Timebase_Now();
+
+        if (++PS2_ScanCodeBuffer_End == PS2_ScanCodeBuffer_Size)
+            PS2_ScanCodeBuffer_End = 0;
+
+        /* 
+         * At the high water mark, inhibit the keyboard (hold Clock low).
+         * The keyboard is still holding Clock low for this stop bit, so
+         * there is no falling edge, but clear the flag in case we are late.
+         */
+        if (PS2_ScanCodes_Waiting() >= PS2_BUFFER_HIGH_WATER)
         {
-    		/* If valid ScanCode, add to Buffer */
-            PS2_ScanCodeBuffer[PS2_ScanCodeBuffer_End] = data;
-
-            if (++PS2_ScanCodeBuffer_End == PS2_ScanCodeBuffer_Size)
-                PS2_ScanCodeBuffer_End = 0;
+            VPORTF.DIR |= PS2_Clock_bm;
+            VPORTF.INTFLAGS = PS2_Clock_bm;
+            PS2_Inhibited = true;
+            Health_Hot.ps2_Inhibits++;
+        }
 
-            /* If buffer is now full, drop oldest value */
-            if ((PS2_ScanCodeBuffer_End == PS2_ScanCodeBuffer_Start)
-                && (++PS2_ScanCodeBuffer_Start == PS2_ScanCodeBuffer_Size))
-                    PS2_ScanCodeBuffer_Start = 0;
+        /* 
+         * If buffer is now full (i.e. the keyboard ignored the inhibit),
+         * the oldest value would be dropped, possibly a key release prefix.
+         * So flush it all, and recover.
+         */
+        if (PS2_ScanCodeBuffer_End == PS2_ScanCodeBuffer_Start)
+        {
+            PS2_Recovery_Request = true;
+            Health_Hot.ps2_Overflows++;
         }
-        parityCount = 0;
-		bitCount = 0;
-	}
+        Health_Hot.ps2_Frames++;
+    }
+    else
+    {
+        /* 
+         * Parity / framing error, or keyboard overrun (0x00) ScanCode.
+         * A byte is lost, so any buffered ScanCodes can't be trusted.
+         * Flush the buffer, and recover.
+         */
+        PS2_ScanCodeBuffer_Start = PS2_ScanCodeBuffer_End;
+        PS2_Recovery_Request = true;
+        Health_Hot.ps2_FrameErrors++;
+    }
+    parity = 0;
+	bitCount = 0;
+}
+
+/*
+ * Joystick Input - INTERRUPT SERVICE ROUTINE!
+ * Interrupt is called on any edge of any Joystick input pin. A timestamped
+ * snapshot of both Joysticks is buffered, if either has changed.
+ * NOTE: If the Buffer is full (i.e. a long switch bounce), the newest
+ *       buffered event is updated instead, so the final state is never lost.
+ */
+void Joystick_Interrupt(void)
+{
+    static Joystick_Value joyLeft_prev = 0;
+    static Joystick_Value joyRight_prev = 0;
+
+    Joystick_Ports ports = readJoystickPorts();
+    Joystick_Value joyLeft = readJoystick_Left(ports);
+    Joystick_Value joyRight = readJoystick_Right(ports);
+
+    /* Several pins can flag the one change, so only buffer actual changes */
+    if ((joyLeft == joyLeft_prev) && (joyRight == joyRight_prev))
+        return;
+
+    joyLeft_prev = joyLeft;
+    joyRight_prev = joyRight;
+    Health_Hot.joystick_Events++;
+
+#ifdef JOYSTICK_FAST_PATH
+    /*
+     * Commit straight away, unless the main loop owns the MT8816, or events
+     * are already buffered (which must be committed first, in order)
+     */
+    if ((MT8816_Owned == 0) && 
+        (Joystick_EventBuffer_Start == Joystick_EventBuffer_End))
+    {
+        Joystick_Left = joyLeft;
+        Joystick_Right = joyRight;
+        Route_Commit_Joysticks();
+        Health_Hot.joystick_FastCommits++;
+        return;
+    }
+#endif
+
+    uint8_t end = Joystick_EventBuffer_End;
+
+    if (++end == Joystick_EventBuffer_Size)
+        end = 0;
+
+    if (end == Joystick_EventBuffer_Start)
+    {
+        /* Buffer is full, update the newest event */
+        end = Joystick_EventBuffer_End ? Joystick_EventBuffer_End - 1 
+                                       : Joystick_EventBuffer_Size - 1;
+        Joystick_EventBuffer[end].joyLeft = joyLeft;
+        Joystick_EventBuffer[end].joyRight = joyRight;
+        return;
+    }
+
+    Joystick_EventBuffer[Joystick_EventBuffer_End].time = Timebase_Now();
+    Joystick_EventBuffer[Joystick_EventBuffer_End].joyLeft = joyLeft;
+    Joystick_EventBuffer[Joystick_EventBuffer_End].joyRight = joyRight;
+    Joystick_EventBuffer_End = end;
 }
 
+#if JOYSTICK_LEFT_MODE == JOYSTICK_MODE_ANALOG
+/*
+ * Analog Joystick / Paddle sampling (ADC0)
+ * Each conversion complete interrupt takes the result, switches to the other
+ * axis and starts the next conversion. So the ADC runs continuously in the
+ * background (like free running, which can't alternate channels cleanly, as
+ * the next conversion is already under way when the result is ready), and
+ * the main loop never waits on it.
+ * The ADC clock is 250kHz (F_CPU derived), with the longest sample time
+ * (SAMPLEN 255, which also suits high impedance Paddle pots), i.e. about
+ * 268 ADC clocks, 1.07ms, per conversion. So each axis is sampled every
+ * 2.1ms or so (every 1.07ms with ANALOG_PADDLE), which the Health counters
+ * (analog_Samples, and joystick_LatencyMax for conversion to crosspoints)
+ * measure in the field.
+ */
+#define ANALOG_CENTRE 128
+
+#if F_CPU > 8000000UL
+#define ANALOG_PRESC ADC_PRESC_DIV96_gc
+#else
+#define ANALOG_PRESC ADC_PRESC_DIV16_gc
+#endif
+
+static void Analog_Initialize(void)
+{
+    VREF.ADC0REF = VREF_REFSEL_VDD_gc;
+    ADC0.CTRLC = ANALOG_PRESC;
+    ADC0.SAMPCTRL = 255;
+    ADC0.MUXPOS = ANALOG_X_MUXPOS;
+    ADC0.INTCTRL = ADC_RESRDY_bm;
+    ADC0.CTRLA = ADC_RESSEL_10BIT_gc | ADC_ENABLE_bm;
+    ADC0.COMMAND = ADC_STCONV_bm;
+}
+
+/*
+ * Analog_Axis returns the direction (low_bm, high_bm or 0) of an axis sample,
+ * given the axis' current direction (in state). The dead zone is widened by
+ * ANALOG_HYSTERESIS for a direction which is not already engaged.
+ */
+static uint8_t Analog_Axis(uint8_t sample, uint8_t state, uint8_t low_bm, uint8_t high_bm)
+{
+    int16_t offset = (int16_t)sample - ANALOG_CENTRE;
+
+    if (offset < -(int16_t)((state & low_bm) ? ANALOG_DEAD_ZONE
+                            : ANALOG_DEAD_ZONE + ANALOG_HYSTERESIS))
+        return low_bm;
+
+    if (offset > ((state & high_bm) ? ANALOG_DEAD_ZONE
+                  : ANALOG_DEAD_ZONE + ANALOG_HYSTERESIS))
+        return high_bm;
+
+    return 0;
+}
+
+/*
+ * Analog Joystick Input - INTERRUPT SERVICE ROUTINE!
+ * Interrupt is called on each ADC0 conversion complete. A changed direction
+ * is captured (timestamped) just as a Joystick pin change is.
+ */
+ISR(ADC0_RESRDY_vect)
+{
+    uint8_t sample = ADC0.RES >> 2; /* 8-bit (reading RES clears the flag) */
+    uint8_t directions = Analog_Directions;
+
+#ifdef ANALOG_PADDLE
+    directions = Analog_Axis(sample, directions, 0x04, 0x08);
+#else
+    if (ADC0.MUXPOS == ANALOG_X_MUXPOS)
+    {
+        ADC0.MUXPOS = ANALOG_Y_MUXPOS;
+        directions = (directions & 0x03) | Analog_Axis(sample, directions, 0x04, 0x08);
+    }
+    else
+    {
+        ADC0.MUXPOS = ANALOG_X_MUXPOS;
+        directions = (directions & 0x0C) | Analog_Axis(sample, directions, 0x01, 0x02);
+    }
+#endif
+    ADC0.COMMAND = ADC_STCONV_bm;
+    Health_Hot.analog_Samples++;
+
+    if (directions != Analog_Directions)
+    {
+        Analog_Directions = directions;
+        Joystick_Interrupt();
+    }
+}
+#endif
+
+#if defined(SNES_PAD) || defined(SEGA_PAD) || defined(PS2_MOUSE)
+/*
+ * Timebase_Schedule sets a TCA0 Compare channel (CMP0 - CMP2, whose
+ * interrupt then runs a timed step, e.g. a pad poll) to when, but at least
+ * ticks whole ticks from now, and returns the time set.
+ * NOTE: The 16-bit CNT read and CMPn write use the TCA0 TEMP register, so
+ *       are made atomic (as in Timebase_Now).
+ */
+static uint16_t Timebase_Schedule(volatile uint16_t *compare, uint16_t when, uint16_t ticks)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        uint16_t soonest = TCA0.SINGLE.CNT + ticks + 1;
+
+        if (Timebase_Before(when, soonest))
+            when = soonest;
+        *compare = when;
+    }
+    return when;
+}
+#endif
+
+#ifdef SNES_PAD
+/*
+ * SNES / NES pad polling
+ * A TCA0 Compare 0 interrupt steps the poll, scheduled on the Timebase:
+ *  step 0 - Latch high (the pad loads its buttons), for at least one tick,
+ *  step 1 - Latch low, shift in the first 8 bits (B Y Sl St U D L R),
+ *  step 2 - shift in the last 8 bits (A X L R), and capture the Joysticks.
+ * Both ports (if both are SNES pads) are read together. Each shift step is
+ * 8 Clock pulses (about 16us, with SNES_CLOCK_HALF_ns 1000), which is
+ * the longest this Level 0 ISR holds off the main loop (or a Joystick ISR),
+ * and the PS/2 ISR still preempts it.
+ * Polls start every SNES_POLL_TICKS, whatever the ISR latency, so a button
+ * is captured (then timestamped, just as a Joystick pin change is) within
+ * SNES_POLL_us + SNES_LATCH_TICKS + 3 ticks (about 1.06ms at 4MHz) of
+ * changing, i.e. the added latency over an Atari Joystick. Health.pad_Polls counts the polls, for the actual poll rate.
+ */
+#define SNES_POLL_TICKS TICKS_FROM_US(SNES_POLL_us)
+#define SNES_LATCH_TICKS TICKS_FROM_US(12)
+#define SNES_HALF_CYCLES CYCLES_FROM_NS(SNES_CLOCK_HALF_ns)
+
+static uint16_t SNES_PollTime;
+
+static void SNES_Initialize(void)
+{
+#if JOYSTICK_LEFT_MODE == JOYSTICK_MODE_SNES
+    VPORTD.OUT = (VPORTD.OUT & ~SNES_LEFT_LATCH_bm) | SNES_LEFT_CLOCK_bm;
+    VPORTD.DIR |= SNES_LEFT_LATCH_bm | SNES_LEFT_CLOCK_bm;
+#endif
+#if JOYSTICK_RIGHT_MODE == JOYSTICK_MODE_SNES
+    VPORTC.OUT = (VPORTC.OUT & ~SNES_RIGHT_LATCH_bm) | SNES_RIGHT_CLOCK_bm;
+    VPORTC.DIR |= SNES_RIGHT_LATCH_bm | SNES_RIGHT_CLOCK_bm;
+#endif
+    TCA0.SINGLE.INTFLAGS = TCA_SINGLE_CMP0_bm;
+    SNES_PollTime = Timebase_Schedule(&TCA0.SINGLE.CMP0,
+                                      Timebase_Now() + SNES_POLL_TICKS, 1);
+    TCA0.SINGLE.INTCTRL |= TCA_SINGLE_CMP0_bm;
+}
+
+/*
+ * SNES_Shift shifts in the next 8 bits from the pad(s), first bit in bit 0
+ * (a bit is 1 if the button is pressed). Data is read, then the Clock pulsed
+ * low / high, the rising edge shifting out the next bit.
+ */
+static inline void SNES_Shift(uint8_t *left, uint8_t *right)
+{
+    uint8_t bitsLeft = 0;
+    uint8_t bitsRight = 0;
+
+    for(uint8_t bit = 0x01; bit; bit <<= 1 )
+    {
+#if JOYSTICK_LEFT_MODE == JOYSTICK_MODE_SNES
+        if (!(VPORTD.IN & SNES_LEFT_DATA_bm))
+            bitsLeft |= bit;
+        VPORTD.OUT &= ~SNES_LEFT_CLOCK_bm;
+#endif
+#if JOYSTICK_RIGHT_MODE == JOYSTICK_MODE_SNES
+        if (!(VPORTC.IN & SNES_RIGHT_DATA_bm))
+            bitsRight |= bit;
+        VPORTC.OUT &= ~SNES_RIGHT_CLOCK_bm;
+#endif
+        __builtin_avr_delay_cycles(SNES_HALF_CYCLES);
+#if JOYSTICK_LEFT_MODE == JOYSTICK_MODE_SNES
+        VPORTD.OUT |= SNES_LEFT_CLOCK_bm;
+#endif
+#if JOYSTICK_RIGHT_MODE == JOYSTICK_MODE_SNES
+        VPORTC.OUT |= SNES_RIGHT_CLOCK_bm;
+#endif
+        __builtin_avr_delay_cycles(SNES_HALF_CYCLES);
+    }
+    *left = bitsLeft;
+    *right = bitsRight;
+}
+
+/*
+ * SNES_Joystick returns the Joystick value (0b00BBRLDU) of a pad's 16 bits
+ *  low  = B Y Select Start Up Down Left Right (bit 0 - 7),
+ *  high = A X L R (bit 0 - 3), all 0 on a NES pad.
+ */
+static inline uint8_t SNES_Joystick(uint8_t low, uint8_t high)
+{
+    uint8_t joy = low >> 4;         /* Up Down Left Right = 0b0000RLDU */
+
+    if ((low | high) & 0x01)        /* B or A */
+        joy |= 0x10;
+    if ((low | high) & 0x02)        /* Y or X */
+        joy |= 0x20;
+    return joy;
+}
+
+/*
+ * SNES pad poll - INTERRUPT SERVICE ROUTINE!
+ * Interrupt is called at each poll step time (TCA0 Compare 0).
+ */
+ISR(TCA0_CMP0_vect)
+{
+    static uint8_t step = 0;
+    static uint8_t lowLeft, lowRight;
+    uint8_t highLeft, highRight;
+
+    TCA0.SINGLE.INTFLAGS = TCA_SINGLE_CMP0_bm;
+
+    switch (step)
+    {
+        case 0:
+#if JOYSTICK_LEFT_MODE == JOYSTICK_MODE_SNES
+            VPORTD.OUT |= SNES_LEFT_LATCH_bm;
+#endif
+#if JOYSTICK_RIGHT_MODE == JOYSTICK_MODE_SNES
+            VPORTC.OUT |= SNES_RIGHT_LATCH_bm;
+#endif
+            Timebase_Schedule(&TCA0.SINGLE.CMP0, SNES_PollTime, SNES_LATCH_TICKS);
+            step = 1;
+            return;
+
+        case 1:
+#if JOYSTICK_LEFT_MODE == JOYSTICK_MODE_SNES
+            VPORTD.OUT &= ~SNES_LEFT_LATCH_bm;
+#endif
+#if JOYSTICK_RIGHT_MODE == JOYSTICK_MODE_SNES
+            VPORTC.OUT &= ~SNES_RIGHT_LATCH_bm;
+#endif
+            SNES_Shift(&lowLeft, &lowRight);
+            Timebase_Schedule(&TCA0.SINGLE.CMP0, SNES_PollTime, 1);
+            step = 2;
+            return;
+    }
+
+    SNES_Shift(&highLeft, &highRight);
+#if JOYSTICK_LEFT_MODE == JOYSTICK_MODE_SNES
+    Pad_Left = SNES_Joystick(lowLeft, highLeft);
+#endif
+#if JOYSTICK_RIGHT_MODE == JOYSTICK_MODE_SNES
+    Pad_Right = SNES_Joystick(lowRight, highRight);
+#endif
+    Health_Hot.pad_Polls++;
+    Joystick_Interrupt();
+
+    SNES_PollTime = Timebase_Schedule(&TCA0.SINGLE.CMP0,
+                                      SNES_PollTime + SNES_POLL_TICKS, 1);
+    step = 0;
+}
+#endif
+
+#ifdef SEGA_PAD
+/*
+ * Sega pad polling
+ * A TCA0 Compare 1 interrupt runs each poll, as one Select sequence (Select
+ * idles high), reading the pad(s) at:
+ *  read 0, Select high (idle) - Up Down Left Right B C
+ *  read 1, 1st Select low     - Up Down 0 0 A Start (Left & Right both low
+ *                               only on a Mega Drive pad)
+ *  read 2, 3rd Select low     - 0 0 0 0 A Start (all low only on a 6-button
+ *                               pad)
+ *  read 3, 4th Select high    - Z Y X Mode B C (6-button pad)
+ * leaving Select high (idle) again. Both ports (if both are Sega pads) are
+ * read together, so the whole sequence is SEGA_SEQUENCE_CYCLES (about 20us,
+ * as only the PS/2 ISR can preempt it), far inside the 6-button timeout.
+ * The next poll is then scheduled SEGA_POLL_TICKS on, but never less than
+ * SEGA_TIMEOUT_TICKS after this sequence ended. So the pad has always reset
+ * its sequence, whatever the ISR latency.
+ * A button is captured (timestamped, just as a Joystick pin change is)
+ * within SEGA_POLL_us (plus a tick) of changing, i.e. the added latency over
+ * an Atari Joystick. Health.pad_Polls counts the polls.
+ */
+#define SEGA_POLL_TICKS TICKS_FROM_US(SEGA_POLL_us)
+#define SEGA_TIMEOUT_TICKS TICKS_FROM_US(SEGA_TIMEOUT_us)
+#define SEGA_SETTLE_CYCLES CYCLES_FROM_NS(SEGA_SETTLE_ns)
+#define SEGA_SEQUENCE_CYCLES (6 * (SEGA_SETTLE_CYCLES + 20))
+
+#if SEGA_POLL_us < (SEGA_TIMEOUT_us + 100)
+#error "SEGA_POLL_us must leave the Select line idle for SEGA_TIMEOUT_us"
+#endif
+
+#if SEGA_SEQUENCE_CYCLES > CYCLES_FROM_NS(SEGA_TIMEOUT_us * 1000UL / 4)
+#error "Sega pad Select sequence is too long for the 6-button timeout"
+#endif
+
+static uint16_t Sega_PollTime;
+
+static void Sega_Initialize(void)
+{
+#if JOYSTICK_LEFT_MODE == JOYSTICK_MODE_SEGA
+    SEGA_LEFT_SELECT_VPORT.OUT |= SEGA_LEFT_SELECT_bm;
+    SEGA_LEFT_SELECT_VPORT.DIR |= SEGA_LEFT_SELECT_bm;
+#endif
+#if JOYSTICK_RIGHT_MODE == JOYSTICK_MODE_SEGA
+    SEGA_RIGHT_SELECT_VPORT.OUT |= SEGA_RIGHT_SELECT_bm;
+    SEGA_RIGHT_SELECT_VPORT.DIR |= SEGA_RIGHT_SELECT_bm;
+#endif
+    TCA0.SINGLE.INTFLAGS = TCA_SINGLE_CMP1_bm;
+    Sega_PollTime = Timebase_Schedule(&TCA0.SINGLE.CMP1,
+                                      Timebase_Now() + SEGA_POLL_TICKS, SEGA_TIMEOUT_TICKS);
+    TCA0.SINGLE.INTCTRL |= TCA_SINGLE_CMP1_bm;
+}
+
+/*
+ * Sega_Select sets the pad(s) Select line high or low, and waits for the
+ * pad(s) to settle
+ */
+static inline void Sega_Select(bool high)
+{
+#if JOYSTICK_LEFT_MODE == JOYSTICK_MODE_SEGA
+    if (high)
+        SEGA_LEFT_SELECT_VPORT.OUT |= SEGA_LEFT_SELECT_bm;
+    else
+        SEGA_LEFT_SELECT_VPORT.OUT &= ~SEGA_LEFT_SELECT_bm;
+#endif
+#if JOYSTICK_RIGHT_MODE == JOYSTICK_MODE_SEGA
+    if (high)
+        SEGA_RIGHT_SELECT_VPORT.OUT |= SEGA_RIGHT_SELECT_bm;
+    else
+        SEGA_RIGHT_SELECT_VPORT.OUT &= ~SEGA_RIGHT_SELECT_bm;
+#endif
+    __builtin_avr_delay_cycles(SEGA_SETTLE_CYCLES);
+}
+
+/* Sega_Read reads the pad(s) port pins (as an Atari Joystick), together */
+static inline void Sega_Read(uint8_t *read, uint8_t n)
+{
+    Joystick_Ports ports = readJoystickPorts();
+
+#if JOYSTICK_LEFT_MODE == JOYSTICK_MODE_SEGA
+    read[n] = readJoystickPort_Left(ports);
+#endif
+#if JOYSTICK_RIGHT_MODE == JOYSTICK_MODE_SEGA
+    read[n + 4] = readJoystickPort_Right(ports);
+#endif
+}
+
+/*
+ * Sega_Joystick returns the Joystick value of a pad's 4 reads (see above).
+ * A pad without Select (Master System pad, or Atari Joystick) reads as is.
+ */
+static Joystick_Value Sega_Joystick(const uint8_t *read)
+{
+    Joystick_Value joy;
+
+    if ((read[1] & 0x0C) != 0x0C)
+        return read[0];
+
+    joy = read[0] & 0x0F;                       /* Up Down Left Right */
+    if (read[1] & 0x10)
+        joy |= 0x010;                           /* A = Button 1 */
+    if (read[0] & 0x10)
+        joy |= 0x020;                           /* B = Button 2 */
+    if (read[1] & 0x20)
+        joy |= 0x040;                           /* Start */
+    if (read[0] & 0x20)
+        joy |= 0x080;                           /* C */
+
+    if ((read[2] & 0x0F) == 0x0F)               /* 6-button pad */
+    {
+        if (read[3] & 0x04)
+            joy |= 0x100;                       /* X */
+        if (read[3] & 0x02)
+            joy |= 0x200;                       /* Y */
+        if (read[3] & 0x01)
+            joy |= 0x400;                       /* Z */
+        if (read[3] & 0x08)
+            joy |= 0x800;                       /* Mode */
+    }
+    return joy;
+}
+
+/*
+ * Sega pad poll - INTERRUPT SERVICE ROUTINE!
+ * Interrupt is called at each poll time (TCA0 Compare 1).
+ */
+ISR(TCA0_CMP1_vect)
+{
+    uint8_t read[8];    /* Left reads 0 - 3, Right reads 4 - 7 */
+
+    TCA0.SINGLE.INTFLAGS = TCA_SINGLE_CMP1_bm;
+
+    Sega_Read(read, 0);
+    Sega_Select(false);
+    Sega_Read(read, 1);
+    Sega_Select(true);
+    Sega_Select(false);
+    Sega_Select(true);
+    Sega_Select(false);
+    Sega_Read(read, 2);
+    Sega_Select(true);
+    Sega_Read(read, 3);
+
+#if JOYSTICK_LEFT_MODE == JOYSTICK_MODE_SEGA
+    Pad_Left = Sega_Joystick(&read[0]);
+#endif
+#if JOYSTICK_RIGHT_MODE == JOYSTICK_MODE_SEGA
+    Pad_Right = Sega_Joystick(&read[4]);
+#endif
+    Health_Hot.pad_Polls++;
+    Joystick_Interrupt();
+
+    Sega_PollTime = Timebase_Schedule(&TCA0.SINGLE.CMP1,
+                                      Sega_PollTime + SEGA_POLL_TICKS, SEGA_TIMEOUT_TICKS);
+}
+#endif
+
+#ifdef PS2_MOUSE
+/*
+ * PS/2 Mouse modulator
+ * A TCA0 Compare 2 interrupt steps a slot every MOUSE_SLOT_us. Each axis'
+ * direction is On for the first dutyX (or dutyY) slots of every MOUSE_SLOTS
+ * slot period, and Off for the rest, so the faster the mouse moves, the
+ * larger the share of the time the Joystick is pushed that way. Both axes
+ * start each period together, so a diagonal movement is a diagonal (and
+ * not alternating directions). Movement stops MOUSE_HOLD_SLOTS after the
+ * last packet (i.e. the mouse has stopped, as it only reports movement).
+ * Only changes are captured (as a Joystick pin change is), so at most four
+ * per period.
+ */
+#define MOUSE_SLOT_TICKS TICKS_FROM_US(MOUSE_SLOT_us)
+
+static uint16_t Mouse_SlotTime;
+
+static void Mouse_Initialize(void)
+{
+    Mouse_Time = Timebase_Now();
+    TCA0.SINGLE.INTFLAGS = TCA_SINGLE_CMP2_bm;
+    Mouse_SlotTime = Timebase_Schedule(&TCA0.SINGLE.CMP2,
+                                       Timebase_Now() + MOUSE_SLOT_TICKS, 1);
+    TCA0.SINGLE.INTCTRL |= TCA_SINGLE_CMP2_bm;
+}
+
+/*
+ * PS/2 Mouse modulator slot - INTERRUPT SERVICE ROUTINE!
+ * Interrupt is called at each slot time (TCA0 Compare 2).
+ */
+ISR(TCA0_CMP2_vect)
+{
+    static uint8_t slot = 0;
+    uint8_t joy = Mouse.buttons;
+
+    TCA0.SINGLE.INTFLAGS = TCA_SINGLE_CMP2_bm;
+
+    if (Mouse.hold)
+    {
+        Mouse.hold--;
+        if (slot < Mouse.dutyX)
+            joy |= Mouse.dirX;
+        if (slot < Mouse.dutyY)
+            joy |= Mouse.dirY;
+    }
+    if (++slot == MOUSE_SLOTS)
+        slot = 0;
+
+    if (joy != Mouse_Joystick)
+    {
+        Mouse_Joystick = joy;
+        Joystick_Interrupt();
+    }
+
+    Mouse_SlotTime = Timebase_Schedule(&TCA0.SINGLE.CMP2,
+                                       Mouse_SlotTime + MOUSE_SLOT_TICKS, 1);
+}
+#endif
+
 /*
  * Main Application
  */
@@ -1360,21 +4276,81 @@ int main(void)
     /* MCC defined System Setup (initialize) */
     SYSTEM_Initialize();
 
-    /* Software Reset all the MT8816 switches to OFF */
+    /* Reset all the MT8816 switches to OFF */
     MT8816_Reset();   
-    
+
+#ifdef MT8816_WRITE_QUEUE
+    /* Start the MT8816 write queue drain timer */
+    MT8816_Queue_Initialize();
+#endif
+
+    /* Restore the last selected Route Profile */
+    Route_Profile_Restore();
+
+    /* Start the input event Timebase */
+    Timebase_Initialize();
+
+#ifdef PS2_CLOCK_FILTER
+    /* Route the PS/2 Clock through the glitch filter */
+    PS2_Clock_Filter_Initialize();
+
+    /* PS/2 Clock (CCL) interrupt is Level 1 (high) priority */
+    CPUINT.LVL1VEC = CCL_CCL_vect_num;
+#else
+    /* PS/2 Clock (PORTF) interrupt is Level 1 (high) priority */
+    CPUINT.LVL1VEC = PORTF_PORT_vect_num;
+#endif
+
+    /* Setup Joystick (pin change) Interrupt handler routine */
+#if JOYSTICK_RIGHT_MODE == JOYSTICK_MODE_ATARI
+#ifndef TELEMETRY_USART
+    IO_PC0_SetInterruptHandler(Joystick_Interrupt); /* PC0 = USART1 TXD */
+#endif
+    IO_PC1_SetInterruptHandler(Joystick_Interrupt);
+    IO_PC2_SetInterruptHandler(Joystick_Interrupt);
+    IO_PC3_SetInterruptHandler(Joystick_Interrupt);
+    IO_PD0_SetInterruptHandler(Joystick_Interrupt);
+    IO_PD1_SetInterruptHandler(Joystick_Interrupt);
+#endif
+#if JOYSTICK_LEFT_MODE == JOYSTICK_MODE_ATARI
+    IO_PD2_SetInterruptHandler(Joystick_Interrupt);
+    IO_PD3_SetInterruptHandler(Joystick_Interrupt);
+    IO_PD4_SetInterruptHandler(Joystick_Interrupt);
+    IO_PD5_SetInterruptHandler(Joystick_Interrupt);
+#elif JOYSTICK_LEFT_MODE == JOYSTICK_MODE_ANALOG
+    Analog_Initialize(); /* PD2 & PD3 = AIN2 & AIN3 */
+#endif
+#if (JOYSTICK_LEFT_MODE == JOYSTICK_MODE_ATARI) || \
+    (JOYSTICK_LEFT_MODE == JOYSTICK_MODE_ANALOG)
+    IO_PD6_SetInterruptHandler(Joystick_Interrupt);
+    IO_PD7_SetInterruptHandler(Joystick_Interrupt);
+#endif
+#ifdef SNES_PAD
+    SNES_Initialize();
+#endif
+#ifdef SEGA_PAD
+    Sega_Initialize();
+#endif
+#ifdef PS2_MOUSE
+    Mouse_Initialize();
+#endif
+
+    /* Capture the initial Joystick state (e.g. a button held at power On) */
+    ATOMIC_BLOCK(ATOMIC_FORCEON)
+    {
+        Joystick_Interrupt();
+    }
+
+#if !defined(PS2_DIRECT_VECTOR) && !defined(PS2_CLOCK_FILTER)
     /* Setup PS/2 Keyboard Interrupt handler routine */
     IO_PF0_SetInterruptHandler(PS2_Interrupt);
+#endif
     
     /* Let's do this forever! */
     while(1)
     {
 
-        process_Joystick_Left();
-        
-        process_Joystick_Right();
- 
-        process_PS2_ScanCode();
+        Scheduler_Run();
 
         /* Yep, that's it. :) */
         
@@ -0,0 +1,439 @@
+/*
+ * CreatiVision Controller Interface - PS/2 Decoder Fuzz Harness
+ * -------------------------------------------------------------
+ *
+ * Feeds arbitrary PS/2 byte streams through the firmware (src/main.c,
+ * compiled for the host), against a mock MT8816, to find decoder state
+ * leaks (i.e. stuck keys) unattended.
+ *
+ * Each input byte is clocked into the PS/2 ISR as a valid PS/2 frame (so
+ * 0x00, a keyboard overrun, is a frame error), and the main loop Scheduler
+ * is run between bytes as the first input byte selects (so batches split
+ * at varying points), and whenever the keyboard is inhibited. At each of
+ * those points, the Joysticks' pins are also set from the byte (so with
+ * JOYSTICK_FAST_PATH, the Joystick ISR commits between PS/2 batches).
+ *
+ * Invariants (any failure aborts, as libFuzzer / AFL expect):
+ *  - the mock MT8816 always matches the MT8816 shadow state,
+ *  - no crosspoint is ever switched On outside the keymap, i.e. the
+ *    keyboard keys' routes in the active Route Profile, and the routes of
+ *    the Joystick Sources active at the time,
+ *  - the firmware's own crosspoint invariant check never fails,
+ *  - after a "release all" tail (idle Joysticks, and a release of every
+ *    ScanCode, plain and extended), and after a keyboard BAT, no switch is
+ *    left On.
+ *
+ * With PS2_MOUSE, the input bytes are mouse bytes instead, the harness
+ * answers the firmware's Enable Data Reporting (FA), and a modulator slot
+ * runs per byte time. The "release all" tail is then still packets, and
+ * the BAT a mouse BAT (AA 00).
+ *
+ * Build and run:  see the Makefile.
+ *  ./fuzz_ps2 [file ...]      runs each file (or stdin) as one input (AFL)
+ *  ./fuzz_ps2 -r count [seed] runs count random inputs
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+static void MT8816_Mock_Write(uint8_t portValue);
+
+/* The firmware, with its MT8816 port writes redirected (see Makefile) */
+#define main firmware_main
+#include "firmware.c"
+#undef main
+
+VPORT_t VPORTA, VPORTC, VPORTD, VPORTF;
+PORT_t PORTA, PORTC, PORTD, PORTF;
+TCA_t TCA0;
+TCB_t TCB0, TCB1, TCB2;
+CCL_t CCL;
+EVSYS_t EVSYS;
+ADC_t ADC0;
+VREF_t VREF;
+CPUINT_t CPUINT;
+NVMCTRL_t NVMCTRL;
+USART_t USART0, USART1, USART2;
+
+/* The PS/2 Clock falling edge interrupt (see PS2_CLOCK_FILTER) */
+#if defined(PS2_CLOCK_FILTER)
+#define PS2_Clock_Edge CCL_CCL_vect
+#elif defined(PS2_DIRECT_VECTOR)
+#define PS2_Clock_Edge PORTF_PORT_vect
+#else
+#define PS2_Clock_Edge PS2_Interrupt
+#endif
+
+#define FUZZ_MAX_INPUT 4096
+#define FUZZ_MAX_RUNS  1000
+
+static void PS2_Send(uint8_t data);
+
+static void fail(const char *invariant)
+{
+    fprintf(stderr, "fuzz_ps2: invariant failed: %s\n", invariant);
+    abort();
+}
+
+/*
+ * Mock MT8816
+ * A Switch is latched on the Strobe rising edge, as the Data bit says.
+ * The port value to Switch address decode is the inverse of the
+ * firmware's MT8816_PortValue, which must be a one to one mapping.
+ */
+static uint8_t Mock_Switch[MT8816_CROSSPOINTS];
+static uint8_t Mock_Address[MT8816_CROSSPOINTS];
+static uint8_t Mock_Port = 0;
+
+/*
+ * Keymap_Allowed returns the crosspoints which may be On right now: every
+ * keyboard key's route in the active Route Profile (none with PS2_MOUSE),
+ * and the routes of the Joystick Sources now active.
+ */
+static uint64_t Keymap_Allowed(void)
+{
+    uint64_t allowed = 0;
+
+    for(uint8_t source = 0; source < ROUTE_SOURCES; source++ )
+    {
+#ifdef PS2_MOUSE
+        bool keyboard = false;
+#else
+        bool keyboard = source < ROUTE_JOYL;
+#endif
+        if (keyboard ||
+            ((source >= ROUTE_JOYL) && 
+             (Route_Active[source >> 3] & Crosspoint_bm[source & 0x07])))
+            allowed |= Route_Table[source];
+    }
+    return allowed;
+}
+
+static void MT8816_Mock_Write(uint8_t portValue)
+{
+    if ((portValue & MT_Strobe_bm) && !(Mock_Port & MT_Strobe_bm))
+    {
+        uint8_t address = Mock_Address[portValue & 0x3F];
+        bool on = (portValue & MT_Data_bm) != 0;
+
+        if (on && !(Keymap_Allowed() & (1ULL << address)))
+            fail("crosspoint outside the keymap switched On");
+        Mock_Switch[address] = on;
+    }
+    Mock_Port = portValue;
+}
+
+static void Mock_Initialize(void)
+{
+    uint8_t seen[MT8816_CROSSPOINTS] = { 0 };
+
+    for(uint8_t address = 0; address < MT8816_CROSSPOINTS; address++ )
+    {
+        uint8_t portValue = MT8816_PortValue(address) & 0x3F;
+
+        if (seen[portValue]++)
+            fail("MT8816_PortValue is not one to one");
+        Mock_Address[portValue] = address;
+    }
+}
+
+static void Mock_Check(bool released)
+{
+#ifdef MT8816_WRITE_QUEUE
+    /* Drain the write queue first, as TCB2 would */
+    while (TCB2.INTCTRL)
+        TCB2_INT_vect();
+#endif
+    for(uint8_t address = 0; address < MT8816_CROSSPOINTS; address++ )
+    {
+        if (Mock_Switch[address] != Crosspoint_Test(MT8816_Shadow, address))
+            fail("MT8816 does not match the shadow state");
+        if (released && Mock_Switch[address])
+            fail("switch left On after all keys released");
+    }
+    if (Invariant_Fail_Count)
+        fail("check_Crosspoint_Invariants");
+}
+
+/*
+ * PS/2 Clock: clocks a frame into the PS/2 ISR, or out of it while the
+ * firmware is sending (the data bits are then ignored)
+ */
+static void PS2_Clock_Frame(uint16_t frame)
+{
+    for(uint8_t lp = 0; lp < 11; lp++ )
+    {
+        if (frame & (1 << lp))
+            VPORTF.IN |= PS2_Data_bm;
+        else
+            VPORTF.IN &= ~PS2_Data_bm;
+        PS2_Clock_Edge();
+    }
+}
+
+/*
+ * PS/2 byte frame: start, 8 data bits LSB first, odd parity, stop
+ */
+static uint16_t PS2_Frame(uint8_t data)
+{
+    uint16_t frame = (1 << 10) | (data << 1);
+    uint8_t parity = 1;
+
+    for(uint8_t lp = 0; lp < 8; lp++ )
+        parity ^= (data >> lp) & 1;
+    return frame | (parity << 9);
+}
+
+#ifdef PS2_MOUSE
+/*
+ * PS/2 mouse: clocks out a command the firmware is sending (Enable Data
+ * Reporting), and acknowledges it (FA)
+ */
+static void Mouse_Answer(void)
+{
+    if ((Mouse_State != MOUSE_WAIT_ACK) || !PS2_Transmitting)
+        return;
+
+    PS2_Clock_Frame(0);
+    PS2_Clock_Frame(PS2_Frame(0xFA));
+}
+
+/* Runs count mouse modulator slots (TCA0 Compare 2) */
+static void Mouse_Slots(uint8_t count)
+{
+    while (count--)
+    {
+        TCA0_CMP2_vect();
+        Scheduler_Run();
+    }
+}
+
+#define MOUSE_BUSY (Mouse_BAT || (Mouse_State != MOUSE_ENABLED))
+#else
+#define MOUSE_BUSY false
+#endif
+
+/*
+ * Main loop: run the Scheduler until there is nothing left to do (the
+ * Timebase advances 100us per pass)
+ */
+static void Main_Loop(void)
+{
+    uint16_t passes = 0;
+
+    while (PS2_ScanCodes_Waiting() || PS2_Recovery_Request || PS2_Inhibited ||
+           MOUSE_BUSY)
+    {
+        if (++passes > FUZZ_MAX_RUNS)
+            fail("PS/2 buffer never drains");
+        TCA0.SINGLE.CNT += TICKS_FROM_US(100);
+        Scheduler_Run();
+#ifdef PS2_MOUSE
+        Mouse_Answer();
+#endif
+    }
+    for(uint8_t lp = 0; lp < SCHEDULER_TASKS; lp++ )
+        Scheduler_Run();
+    Mock_Check(false);
+}
+
+/*
+ * PS/2 keyboard (or mouse): clocks a byte into the PS/2 ISR, about 1ms per
+ * byte. An inhibited keyboard holds the byte until released (and a mouse
+ * until reporting is enabled).
+ */
+static void PS2_Send(uint8_t data)
+{
+    if (PS2_Inhibited || MOUSE_BUSY)
+        Main_Loop();
+
+    PS2_Clock_Frame(PS2_Frame(data));
+    TCA0.SINGLE.CNT += TICKS_FROM_US(1000);
+#ifdef PS2_MOUSE
+    Mouse_Slots(1);
+#endif
+}
+
+/*
+ * Joysticks: sets both Joystick ports' pins (active low, any combination,
+ * invalid directions included) and runs the pin change ISR
+ */
+static void Joystick_Move(uint8_t pins)
+{
+    VPORTC.IN = (uint8_t)~(pins >> 4);
+    VPORTD.IN = (uint8_t)~pins;
+    Joystick_Interrupt();
+}
+
+#ifdef PS2_MOUSE
+/*
+ * Mouse: a packet with no buttons or movement (after resyncing, i.e. any
+ * packet in progress is completed, and any AA 00 is then not a BAT), and
+ * then the modulator runs until the movement hold is over
+ */
+static void PS2_Release_All(void)
+{
+    for(uint8_t lp = 0; lp < 3; lp++ )
+    {
+        PS2_Send(0x08);
+        PS2_Send(0x00);
+        PS2_Send(0x00);
+    }
+    Main_Loop();
+    Mouse_Slots(MOUSE_HOLD_SLOTS + MOUSE_SLOTS);
+    Main_Loop();
+}
+#else
+/* Releases every ScanCode, plain and extended (after any PAUSE sequence) */
+static void PS2_Release_All(void)
+{
+    for(uint8_t lp = 0; lp < 8; lp++ )
+        PS2_Send(0x83); /* 'F7' key, not mapped */
+
+    for(uint8_t scanCode = 0x01; scanCode < 0x80; scanCode++ )
+    {
+        PS2_Send(0xF0);
+        PS2_Send(scanCode);
+        PS2_Send(0xE0);
+        PS2_Send(0xF0);
+        PS2_Send(scanCode);
+    }
+    Main_Loop();
+}
+#endif
+
+static void Harness_Initialize(void)
+{
+    static bool initialized = false;
+
+    if (initialized)
+        return;
+    initialized = true;
+
+    Mock_Initialize();
+    MT8816_Reset();
+    Route_Profile_Restore();
+#ifdef PS2_MOUSE
+    Mouse_Initialize();
+#endif
+
+    /* Joysticks idle (all inputs pulled up) */
+    Joystick_Move(0x00);
+    Main_Loop();
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    uint8_t schedule;
+
+    Harness_Initialize();
+    if ((size == 0) || (size > FUZZ_MAX_INPUT))
+        return 0;
+
+    schedule = *data++;
+    size--;
+
+    for(size_t lp = 0; lp < size; lp++ )
+    {
+        PS2_Send(data[lp]);
+        if (schedule & (1 << (lp & 0x07)))
+        {
+            Joystick_Move(data[lp]);
+            Main_Loop();
+        }
+    }
+    Main_Loop();
+
+    /* Release everything, back to the start state for the next input */
+    Joystick_Move(0x00);
+    PS2_Release_All();
+#ifndef PS2_MOUSE
+    if (KeyJoy_Enabled)
+    {
+        PS2_Send(0x77);
+        PS2_Send(0xF0);
+        PS2_Send(0x77);
+        Main_Loop();
+    }
+#endif
+    Mock_Check(true);
+
+#ifdef PS2_MOUSE
+    /* A mouse BAT releases the buttons too (so also press one first) */
+    PS2_Send(0x09);
+    PS2_Send(0x00);
+    PS2_Send(0x00);
+    PS2_Send(0xAA);
+    PS2_Send(0x00);
+    Main_Loop();
+    Mouse_Slots(1);
+    Main_Loop();
+#else
+    /* A keyboard BAT releases everything too (so also press a key first) */
+    PS2_Send(0x16);
+    PS2_Send(0xAA);
+    Main_Loop();
+#endif
+    Mock_Check(true);
+
+    Route_Profile_Select(0, false);
+    Main_Loop();
+    return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+static size_t read_input(FILE *file, uint8_t *input)
+{
+    return fread(input, 1, FUZZ_MAX_INPUT, file);
+}
+
+/* Random inputs, weighted towards the prefixes and mapped keys */
+static size_t random_input(uint8_t *input)
+{
+    static const uint8_t interesting[] =
+        { 0xE0, 0xF0, 0xE1, 0xAA, 0xFC, 0x00, 0x77, 0x7E, 0x05, 0x06,
+          0x75, 0x72, 0x6B, 0x74, 0x12, 0x59, 0x14, 0x7C, 0x16, 0x1C };
+    size_t size = 1 + (rand() % 256);
+
+    for(size_t lp = 0; lp < size; lp++ )
+        input[lp] = (rand() & 1) ? interesting[rand() % sizeof(interesting)]
+                                 : (uint8_t)rand();
+    return size;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t input[FUZZ_MAX_INPUT];
+
+    if ((argc >= 3) && (strcmp(argv[1], "-r") == 0))
+    {
+        long count = atol(argv[2]);
+
+        srand((argc >= 4) ? (unsigned)atol(argv[3]) : 1);
+        for(long lp = 0; lp < count; lp++ )
+            LLVMFuzzerTestOneInput(input, random_input(input));
+        printf("fuzz_ps2: %ld random inputs, all invariants held\n", count);
+        return 0;
+    }
+
+    if (argc < 2)
+        return LLVMFuzzerTestOneInput(input, read_input(stdin, input));
+
+    for(int lp = 1; lp < argc; lp++ )
+    {
+        FILE *file = fopen(argv[lp], "rb");
+
+        if (file == NULL)
+        {
+            perror(argv[lp]);
+            return 1;
+        }
+        LLVMFuzzerTestOneInput(input, read_input(file, input));
+        fclose(file);
+    }
+    return 0;
+}
+#endif
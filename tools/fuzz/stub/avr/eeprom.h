@@ -0,0 +1,21 @@
+/*
+ * Host stub of avr/eeprom.h (tools/fuzz only)
+ * The only EEPROM byte used (the saved Route Profile) is held in RAM.
+ */
+#pragma once
+#include <stdint.h>
+#define EEMEM
+
+static uint8_t eeprom_stub_byte = 0xFF;
+
+static inline uint8_t eeprom_read_byte(const uint8_t *address)
+{
+    (void)address;
+    return eeprom_stub_byte;
+}
+
+static inline void eeprom_update_byte(uint8_t *address, uint8_t value)
+{
+    (void)address;
+    eeprom_stub_byte = value;
+}
@@ -0,0 +1,6 @@
+/*
+ * Host stub of avr/interrupt.h (tools/fuzz only)
+ * An ISR is just a function, which the harness calls directly.
+ */
+#pragma once
+#define ISR(vector) void vector(void); void vector(void)
@@ -0,0 +1,80 @@
+/*
+ * Host stub of avr/io.h (tools/fuzz only)
+ * Just the AVR DA registers and bit masks src/main.c uses, as plain
+ * structures (defined in fuzz_ps2.c), so the firmware compiles and runs on
+ * the host. Register side effects are modelled by the harness, where they
+ * matter (e.g. the MT8816 port writes).
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#define __builtin_avr_delay_cycles(cycles) ((void)(cycles))
+
+#define PIN0_bm 0x01
+#define PIN1_bm 0x02
+#define PIN2_bm 0x04
+#define PIN3_bm 0x08
+#define PIN4_bm 0x10
+#define PIN5_bm 0x20
+#define PIN6_bm 0x40
+#define PIN7_bm 0x80
+typedef struct { volatile uint8_t DIR, OUT, IN, INTFLAGS; } VPORT_t;
+typedef struct { volatile uint8_t DIR, DIRSET, DIRCLR, DIRTGL, OUT, OUTSET, OUTCLR, OUTTGL, IN, INTFLAGS; } PORT_t;
+extern VPORT_t VPORTA, VPORTC, VPORTD, VPORTF;
+extern PORT_t PORTA, PORTC, PORTD, PORTF;
+typedef struct { volatile uint8_t CTRLA, INTCTRL, INTFLAGS; volatile uint16_t CNT, PER, CMP0, CMP1, CMP2; } TCA_SINGLE_t;
+typedef struct { TCA_SINGLE_t SINGLE; } TCA_t;
+extern TCA_t TCA0;
+#define TCA_SINGLE_CLKSEL_DIV256_gc 0x0E
+#define TCA_SINGLE_CLKSEL_DIV64_gc 0x0A
+#define TCA_SINGLE_ENABLE_bm 1
+#define TCA_SINGLE_CMP0_bm 0x10
+#define TCA_SINGLE_CMP1_bm 0x20
+#define TCA_SINGLE_CMP2_bm 0x40
+typedef struct { volatile uint8_t CTRLA, CTRLB, INTCTRL, INTFLAGS; volatile uint16_t CNT, CCMP; } TCB_t;
+extern TCB_t TCB0, TCB1, TCB2;
+#define TCB_CNTMODE_INT_gc 0
+#define TCB_CLKSEL_DIV1_gc 0
+#define TCB_CLKSEL_EVENT_gc 0xE
+#define TCB_ENABLE_bm 1
+#define TCB_CAPT_bm 1
+typedef struct { volatile uint8_t CTRLA, LUT3CTRLA, LUT3CTRLB, LUT3CTRLC, TRUTH3, INTCTRL0, INTFLAGS; } CCL_t;
+extern CCL_t CCL;
+#define CCL_INSEL0_IO_gc 5
+#define CCL_INSEL1_MASK_gc 0
+#define CCL_INSEL2_MASK_gc 0
+#define CCL_FILTSEL_FILTER_gc 0x20
+#define CCL_CLKSRC_CLKPER_gc 0
+#define CCL_ENABLE_bm 1
+#define CCL_INTMODE3_FALLING_gc 0x80
+#define CCL_INT3_bm 8
+typedef struct { volatile uint8_t CHANNEL4, CHANNEL5, USERTCB0COUNT, USERTCB1COUNT; } EVSYS_t;
+extern EVSYS_t EVSYS;
+#define EVSYS_CHANNEL4_PORTF_PIN0_gc 0x40
+#define EVSYS_CHANNEL5_CCL_LUT3_gc 0x13
+#define EVSYS_USER_CHANNEL4_gc 5
+#define EVSYS_USER_CHANNEL5_gc 6
+typedef struct { volatile uint8_t CTRLA, CTRLC, SAMPCTRL, MUXPOS, INTCTRL, COMMAND; volatile uint16_t RES; } ADC_t;
+extern ADC_t ADC0;
+#define ADC_PRESC_DIV96_gc 1
+#define ADC_PRESC_DIV16_gc 2
+#define ADC_MUXPOS_AIN2_gc 2
+#define ADC_MUXPOS_AIN3_gc 3
+#define ADC_RESRDY_bm 1
+#define ADC_RESSEL_10BIT_gc 4
+#define ADC_ENABLE_bm 1
+#define ADC_STCONV_bm 1
+typedef struct { volatile uint8_t ADC0REF; } VREF_t;
+extern VREF_t VREF;
+#define VREF_REFSEL_VDD_gc 5
+typedef struct { volatile uint8_t LVL1VEC; } CPUINT_t;
+extern CPUINT_t CPUINT;
+#define CCL_CCL_vect_num 7
+#define PORTF_PORT_vect_num 8
+typedef struct { volatile uint8_t CTRLA, CTRLB, STATUS; } NVMCTRL_t;
+extern NVMCTRL_t NVMCTRL;
+#define NVMCTRL_EEBUSY_bm 0x02
+typedef struct { volatile uint8_t STATUS, TXDATAL; } USART_t;
+extern USART_t USART0, USART1, USART2;
+#define USART_DREIF_bm 0x20
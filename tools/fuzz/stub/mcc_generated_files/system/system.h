@@ -0,0 +1,23 @@
+/*
+ * Host stub of the MCC generated system.h (tools/fuzz only)
+ * Just enough for src/main.c to compile on the host. The MCC pin change
+ * handlers are never called by the harness, so registering one is a no-op.
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef F_CPU
+#define F_CPU 24000000UL
+#endif
+
+#define IO_HANDLER(pin) \
+    static inline void IO_##pin##_SetInterruptHandler(void (*handler)(void)) \
+    { (void)handler; }
+
+IO_HANDLER(PC0) IO_HANDLER(PC1) IO_HANDLER(PC2) IO_HANDLER(PC3)
+IO_HANDLER(PD0) IO_HANDLER(PD1) IO_HANDLER(PD2) IO_HANDLER(PD3)
+IO_HANDLER(PD4) IO_HANDLER(PD5) IO_HANDLER(PD6) IO_HANDLER(PD7)
+IO_HANDLER(PF0)
+
+static inline void SYSTEM_Initialize(void) { }
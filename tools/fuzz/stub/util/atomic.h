@@ -0,0 +1,9 @@
+/*
+ * Host stub of util/atomic.h (tools/fuzz only)
+ * The harness is single threaded (ISRs are called between main loop
+ * steps), so an atomic block is just a block.
+ */
+#pragma once
+#define ATOMIC_FORCEON
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_BLOCK(type) for (int atomic_once = 1; atomic_once; atomic_once = 0)
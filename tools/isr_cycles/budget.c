@@ -0,0 +1,21 @@
+/*
+ * CreatiVision Controller Interface - ISR Cycle Budget Check
+ * ----------------------------------------------------------
+ *
+ * Compiled (syntax only, see the Makefile) once isr_cycles.py has counted
+ * the compiled Joystick pin change ISRs into measured.h, so the firmware's
+ * own preprocessor checks them against the maximums in src/main.c (see
+ * Interrupt Priority), for the same F_CPU and options. The build fails if
+ * either exceeds them.
+ */
+
+#include "measured.h"
+#include "../../src/main.c"
+
+#if PORTC_ISR_CYCLES > JOYSTICK_ISR_MAX_CYCLES
+#error "PORTC_PORT_vect exceeds JOYSTICK_ISR_MAX_CYCLES"
+#endif
+
+#if PORTD_ISR_CYCLES > JOYSTICK_ISR_MAX_CYCLES
+#error "PORTD_PORT_vect exceeds JOYSTICK_ISR_MAX_CYCLES"
+#endif
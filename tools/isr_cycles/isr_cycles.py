@@ -0,0 +1,284 @@
+#!/usr/bin/env python3
+"""
+CreatiVision Controller Interface - PS/2 ISR Cycle Check
+--------------------------------------------------------
+
+Counts the worst case CPU cycles of the PS/2 ISR in the compiled firmware,
+from its disassembly, and fails (exit 1) if it exceeds the budget set in
+src/main.c:
+
+    PS2_ISR_BUDGET_CYCLES      worst case path through the ISR (at the
+                               given F_CPU), plus INTERRUPT_RESPONSE_CYCLES.
+    PS2_ISR_ENTRY_CYCLES       (with --entry) the cycles from the start of
+                               the ISR to the PS/2 Data sample (the first
+                               VPORTF.IN read), for the given vector option.
+
+Every path through the function is followed (both ways at each branch and
+skip), and the longest is reported, so the ISR must not loop (the build is
+failed if it does). Called functions are counted in full. Cycle counts are
+for the AVRxt core (AVR DA, 16-bit PC) from the AVR Instruction Set Manual.
+
+With --define, any other ISR is counted instead (e.g. the MCC PORTC vector
+calling back Joystick_Interrupt), and its worst case printed as a #define,
+for tools/isr_cycles/budget.c to check against the src/main.c maximums
+(see the Makefile, which builds the firmware and checks both).
+
+Usage:  python3 tools/isr_cycles/isr_cycles.py FILE [options]
+        FILE                the built .elf (disassembled with avr-objdump,
+                            or $AVR_OBJDUMP), or an avr-objdump -d listing.
+        --f-cpu HZ          F_CPU (default 4000000, the tightest budget).
+        --function NAME     the ISR (default PS2_Interrupt, or the vector,
+                            e.g. __vector_N, with PS2_DIRECT_VECTOR or
+                            PS2_CLOCK_FILTER - see the .map file).
+        --icall NAME        the function an icall reaches (e.g. the MCC
+                            PORTF vector calling back PS2_Interrupt).
+        --entry OPTION      also check PS2_ISR_ENTRY_CYCLES for the vector
+                            option: callback, direct or filter.
+        --define NAME       not the PS/2 ISR: print "#define NAME cycles",
+                            the worst case (no budget check).
+
+In MPLAB X, add it as a post build step (Project Properties, Building,
+Execute this line after build), so an over budget ISR fails the build:
+    python3 ../tools/isr_cycles/isr_cycles.py ${ImageDir}/${PROJECTNAME}.${IMAGE_TYPE}.elf
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+TOOL_DIR = os.path.dirname(os.path.abspath(__file__))
+MAIN_C = os.path.join(TOOL_DIR, '..', '..', 'src', 'main.c')
+
+# VPORTF.IN I/O address (VPORTF = 0x0014, IN = +2)
+VPORTF_IN = 0x16
+
+# AVRxt (16-bit PC) cycles, where not 1
+CYCLES = {
+    'adiw': 2, 'sbiw': 2,
+    'mul': 2, 'muls': 2, 'mulsu': 2, 'fmul': 2, 'fmuls': 2, 'fmulsu': 2,
+    'ld': 2, 'ldd': 2, 'lds': 3, 'lpm': 3, 'elpm': 3,
+    'sts': 2, 'pop': 2,
+    'rjmp': 2, 'jmp': 3, 'ijmp': 2,
+    'rcall': 2, 'call': 3, 'icall': 2,
+    'ret': 4, 'reti': 4,
+}
+
+BRANCHES = ('brbc', 'brbs', 'brcc', 'brcs', 'breq', 'brge', 'brhc', 'brhs',
+            'brid', 'brie', 'brlo', 'brlt', 'brmi', 'brne', 'brpl', 'brsh',
+            'brtc', 'brts', 'brvc', 'brvs')
+SKIPS = ('cpse', 'sbrc', 'sbrs', 'sbic', 'sbis')
+UNSUPPORTED = ('eijmp', 'eicall', 'sleep', 'break', 'spm')
+
+
+class CycleError(Exception):
+    pass
+
+
+class Instruction:
+    def __init__(self, address, size, mnemonic, operands, target):
+        self.address = address
+        self.size = size
+        self.mnemonic = mnemonic
+        self.operands = operands
+        self.target = target
+
+    def cycles(self):
+        return CYCLES.get(self.mnemonic, 1)
+
+    def samples_data(self):
+        if self.mnemonic == 'in':
+            return int(self.operands.split(',')[1], 0) == VPORTF_IN
+        if self.mnemonic == 'lds':
+            return int(self.operands.split(',')[1], 0) == VPORTF_IN
+        return False
+
+
+FUNCTION_RE = re.compile(r'^([0-9a-f]+) <([^>]+)>:$')
+INSTRUCTION_RE = re.compile(
+    r'^\s*([0-9a-f]+):\s+((?:[0-9a-f]{2} )+)\s*([a-z]+)\s*([^;]*?)\s*(?:;\s*(?:0x([0-9a-f]+))?.*)?$')
+
+
+def disassemble(path):
+    with open(path, 'rb') as f:
+        elf = f.read(4) == b'\x7fELF'
+    if not elf:
+        with open(path) as f:
+            return f.read()
+    objdump = os.environ.get('AVR_OBJDUMP', 'avr-objdump')
+    return subprocess.run([objdump, '-d', path], check=True,
+                          stdout=subprocess.PIPE, universal_newlines=True).stdout
+
+
+def load_functions(listing):
+    functions = {}
+    code = None
+    for line in listing.splitlines():
+        match = FUNCTION_RE.match(line)
+        if match:
+            code = functions.setdefault(match.group(2), {})
+            continue
+        match = INSTRUCTION_RE.match(line)
+        if match and code is not None:
+            address = int(match.group(1), 16)
+            size = len(match.group(2).split())
+            mnemonic = match.group(3)
+            operands = match.group(4).strip()
+            target = match.group(5)
+            if target is not None:
+                target = int(target, 16)
+            elif mnemonic in ('jmp', 'call'):
+                target = int(operands, 0)
+            code[address] = Instruction(address, size, mnemonic, operands, target)
+    return functions
+
+
+class Analysis:
+    def __init__(self, functions, icall):
+        self.functions = functions
+        self.icall = icall
+        self.starts = {min(code): name for name, code in functions.items() if code}
+        self.memo = {}
+
+    def code(self, name):
+        if name not in self.functions or not self.functions[name]:
+            raise CycleError('function %s not found' % name)
+        return self.functions[name]
+
+    def callee(self, instruction):
+        if instruction.mnemonic == 'icall':
+            if self.icall is None:
+                raise CycleError('icall at 0x%x, please give --icall' % instruction.address)
+            return self.icall
+        if instruction.target not in self.starts:
+            raise CycleError('call at 0x%x to an unknown function' % instruction.address)
+        return self.starts[instruction.target]
+
+    def successors(self, code, instruction):
+        after = instruction.address + instruction.size
+        mnemonic = instruction.mnemonic
+        if mnemonic in UNSUPPORTED or mnemonic == 'ijmp':
+            raise CycleError('%s at 0x%x can not be followed' % (mnemonic, instruction.address))
+        if mnemonic in ('ret', 'reti'):
+            return []
+        if mnemonic in ('rjmp', 'jmp'):
+            return [(instruction.target, 0)]
+        if mnemonic in BRANCHES:
+            return [(after, 0), (instruction.target, 1)]
+        if mnemonic in SKIPS:
+            skipped = code.get(after)
+            if skipped is None:
+                raise CycleError('skip at 0x%x off the end' % instruction.address)
+            return [(after, 0), (after + skipped.size, skipped.size // 2)]
+        return [(after, 0)]
+
+    def longest(self, name, until=None, visiting=()):
+        """
+        Longest path (cycles) from the start of a function to its return,
+        or (until) to the first instruction matching, None if unreached.
+        """
+        key = (name, until)
+        if key in self.memo:
+            return self.memo[key]
+        if name in visiting:
+            raise CycleError('%s is recursive' % name)
+        code = self.code(name)
+        memo = {}
+
+        def walk(address, path):
+            if address in memo:
+                return memo[address]
+            if address in path:
+                raise CycleError('%s loops at 0x%x' % (name, address))
+            instruction = code.get(address)
+            if instruction is None:
+                raise CycleError('%s leaves the function at 0x%x' % (name, address))
+            if until is not None and until(instruction):
+                return 0
+
+            cycles = instruction.cycles()
+            best = None
+            if instruction.mnemonic in ('call', 'rcall', 'icall'):
+                callee = self.callee(instruction)
+                inner = self.longest(callee, until, visiting + (name,))
+                if until is not None and inner is not None:
+                    best = cycles + inner
+                cycles += self.longest(callee, None, visiting + (name,))
+
+            for successor, extra in self.successors(code, instruction):
+                rest = walk(successor, path | {address})
+                if rest is not None:
+                    total = cycles + extra + rest
+                    best = total if best is None else max(best, total)
+            if until is None and not self.successors(code, instruction):
+                best = cycles
+            memo[address] = best
+            return best
+
+        result = walk(min(code), frozenset())
+        self.memo[key] = result
+        return result
+
+
+def read_constants():
+    with open(MAIN_C) as f:
+        text = f.read()
+    budget = re.search(r'#define PS2_ISR_BUDGET_CYCLES CYCLES_FROM_NS\((\d+)UL\)', text)
+    response = re.search(r'#define INTERRUPT_RESPONSE_CYCLES (\d+)', text)
+    entries = re.findall(r'#define PS2_ISR_ENTRY_CYCLES (\d+)', text)
+    if not budget or not response or len(entries) != 3:
+        raise CycleError('PS/2 ISR budget constants not found in src/main.c')
+    # In src/main.c order: PS2_CLOCK_FILTER, PS2_DIRECT_VECTOR, MCC callback
+    entry = dict(zip(('filter', 'direct', 'callback'), map(int, entries)))
+    return int(budget.group(1)), int(response.group(1)), entry
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('file')
+    parser.add_argument('--f-cpu', type=int, default=4000000)
+    parser.add_argument('--function', default='PS2_Interrupt')
+    parser.add_argument('--icall')
+    parser.add_argument('--entry', choices=('callback', 'direct', 'filter'))
+    parser.add_argument('--define')
+    args = parser.parse_args()
+
+    try:
+        analysis = Analysis(load_functions(disassemble(args.file)), args.icall)
+        if args.define:
+            print('#define %s %d' % (args.define, analysis.longest(args.function)))
+            return 0
+        budget_ns, response, entry = read_constants()
+        worst = analysis.longest(args.function) + response
+        sample = analysis.longest(args.function, Instruction.samples_data)
+    except (CycleError, OSError, ValueError, subprocess.CalledProcessError) as error:
+        print('isr_cycles error: %s' % error, file=sys.stderr)
+        return 1
+
+    function = args.function
+    budget = ((budget_ns * (args.f_cpu // 1000000)) + 999) // 1000
+    failed = False
+
+    print('%s worst case: %d cycles (with %d response), budget %d at %dHz'
+          % (function, worst, response, budget, args.f_cpu))
+    if worst > budget:
+        print('PS/2 ISR exceeds PS2_ISR_BUDGET_CYCLES', file=sys.stderr)
+        failed = True
+
+    if sample is None:
+        print('%s never samples the PS/2 Data (VPORTF.IN)' % function, file=sys.stderr)
+        failed = True
+    else:
+        print('%s entry to Data sample: %d cycles' % (function, sample))
+        if args.entry and sample > entry[args.entry]:
+            print('PS/2 ISR entry exceeds PS2_ISR_ENTRY_CYCLES (%s, %d)'
+                  % (args.entry, entry[args.entry]), file=sys.stderr)
+            failed = True
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,29 @@
+/*
+ * Stand-in for the MCC generated system.h (tools/isr_cycles only)
+ * Just enough for src/main.c to build with plain avr-gcc. The pin change
+ * ISRs (pins.c) call back through the registered handlers, as MCC's do.
+ */
+#ifndef SYSTEM_H
+#define SYSTEM_H
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+void SYSTEM_Initialize(void);
+
+void IO_PC0_SetInterruptHandler(void (*handler)(void));
+void IO_PC1_SetInterruptHandler(void (*handler)(void));
+void IO_PC2_SetInterruptHandler(void (*handler)(void));
+void IO_PC3_SetInterruptHandler(void (*handler)(void));
+void IO_PD0_SetInterruptHandler(void (*handler)(void));
+void IO_PD1_SetInterruptHandler(void (*handler)(void));
+void IO_PD2_SetInterruptHandler(void (*handler)(void));
+void IO_PD3_SetInterruptHandler(void (*handler)(void));
+void IO_PD4_SetInterruptHandler(void (*handler)(void));
+void IO_PD5_SetInterruptHandler(void (*handler)(void));
+void IO_PD6_SetInterruptHandler(void (*handler)(void));
+void IO_PD7_SetInterruptHandler(void (*handler)(void));
+void IO_PF0_SetInterruptHandler(void (*handler)(void));
+
+#endif
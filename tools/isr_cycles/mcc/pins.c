@@ -0,0 +1,64 @@
+/*
+ * Stand-in for the MCC generated pins.c (tools/isr_cycles only)
+ * Each pin change ISR checks each pin's flag, calls back its registered
+ * handler (an indirect call), and then clears all the port's flags, as
+ * the MCC Melody pins.c does. The cycle counts are only as good as this
+ * likeness, so please keep it in step with the MCC version in use.
+ */
+#include <avr/interrupt.h>
+#include "mcc_generated_files/system/system.h"
+
+static void IO_Default_Handler(void)
+{
+}
+
+#define IO_HANDLER(pin) \
+    static void (*pin##_InterruptHandler)(void) = IO_Default_Handler; \
+    void IO_##pin##_SetInterruptHandler(void (*handler)(void)) \
+    { \
+        pin##_InterruptHandler = handler; \
+    }
+
+IO_HANDLER(PC0) IO_HANDLER(PC1) IO_HANDLER(PC2) IO_HANDLER(PC3)
+IO_HANDLER(PD0) IO_HANDLER(PD1) IO_HANDLER(PD2) IO_HANDLER(PD3)
+IO_HANDLER(PD4) IO_HANDLER(PD5) IO_HANDLER(PD6) IO_HANDLER(PD7)
+IO_HANDLER(PF0)
+
+#define IO_CALLBACK(vport, pin, n) \
+    if (vport.INTFLAGS & PORT_INT##n##_bm) \
+        pin##_InterruptHandler();
+
+void SYSTEM_Initialize(void)
+{
+}
+
+ISR(PORTC_PORT_vect)
+{
+    IO_CALLBACK(VPORTC, PC0, 0)
+    IO_CALLBACK(VPORTC, PC1, 1)
+    IO_CALLBACK(VPORTC, PC2, 2)
+    IO_CALLBACK(VPORTC, PC3, 3)
+    VPORTC.INTFLAGS = 0xFF;
+}
+
+ISR(PORTD_PORT_vect)
+{
+    IO_CALLBACK(VPORTD, PD0, 0)
+    IO_CALLBACK(VPORTD, PD1, 1)
+    IO_CALLBACK(VPORTD, PD2, 2)
+    IO_CALLBACK(VPORTD, PD3, 3)
+    IO_CALLBACK(VPORTD, PD4, 4)
+    IO_CALLBACK(VPORTD, PD5, 5)
+    IO_CALLBACK(VPORTD, PD6, 6)
+    IO_CALLBACK(VPORTD, PD7, 7)
+    VPORTD.INTFLAGS = 0xFF;
+}
+
+/* Removed with PS2_DIRECT_VECTOR, as the MCC one MUST be (see src/main.c) */
+#ifndef PS2_DIRECT_VECTOR
+ISR(PORTF_PORT_vect)
+{
+    IO_CALLBACK(VPORTF, PF0, 0)
+    VPORTF.INTFLAGS = 0xFF;
+}
+#endif
@@ -0,0 +1,247 @@
+#!/usr/bin/env python3
+"""
+CreatiVision Controller Interface - Keymap Generator
+----------------------------------------------------
+
+Generates the MT8816 Switch address constants and the default PS/2 Keymap
+table in src/main.c, from the declarative keymap files:
+
+    creativision_keys.csv  CreatiVision key / joystick switches, as
+                           CreatiVision Schematic controller pin numbers.
+    ps2_keymap.csv         PS/2 (Scan Code Set 2) codes for each key.
+
+The generated code replaces the text between the matching
+"BEGIN GENERATED" / "END GENERATED" marker comments in src/main.c.
+
+The keymap is validated before anything is written:
+ - every pin must exist on its controller (and be a PIA Port A / Port B pin
+   as appropriate),
+ - no two keyboard keys (or joystick switches) may share both poles (the
+   console could not tell them apart),
+ - every PS/2 code must be unique, and map to a CreatiVision keyboard key.
+
+Every crosspoint shared between a keyboard key and a joystick switch is
+also reported (these are expected, but worth knowing about when remapping).
+
+Usage:  python3 tools/keymap/keymap_gen.py [--check]
+        --check  validate and report only, exit 1 if src/main.c is stale.
+"""
+
+import argparse
+import csv
+import os
+import sys
+
+TOOL_DIR = os.path.dirname(os.path.abspath(__file__))
+MAIN_C = os.path.join(TOOL_DIR, '..', '..', 'src', 'main.c')
+
+# CreatiVision Schematic controller pin -> PIA port pin (see src/main.c)
+PINS = {
+    'L': {1: 'PA1', 2: 'PA0', 3: 'PB0', 4: 'PB1', 5: 'PB2',
+          6: 'PB3', 7: 'PB4', 8: 'PB7', 9: 'PB6', 10: 'PB5'},
+    'R': {1: 'PB2', 2: 'PB1', 3: 'PB0', 4: 'PB3', 5: 'PB4',
+          6: 'PB5', 7: 'PB6', 8: 'PB7', 9: 'PA3', 10: 'PA2'},
+}
+
+# PIA port pin -> MT8816 Switch address bits (as the PIA_ defines)
+PIA_ADDRESS = {
+    'PA0': 0x00, 'PA1': 0x10, 'PA2': 0x28, 'PA3': 0x38,
+    'PB0': 0, 'PB1': 1, 'PB2': 2, 'PB3': 3,
+    'PB4': 4, 'PB5': 5, 'PB6': 6, 'PB7': 7,
+}
+
+GROUPS = {
+    'left_keyboard':  ('L', True,  'CreatiVision Left Controller Keyboard (24 keys)'),
+    'right_keyboard': ('R', True,  'CreatiVision Right Controller Keyboard (24 keys)'),
+    'left_joystick':  ('L', False, 'CreatiVision Left Controller Joystick'),
+    'right_joystick': ('R', False, 'CreatiVision Right Controller Joystick'),
+}
+
+
+class KeymapError(Exception):
+    pass
+
+
+def read_csv(name):
+    path = os.path.join(TOOL_DIR, name)
+    with open(path, newline='') as f:
+        lines = [line for line in f if not line.startswith('#')]
+    return list(csv.DictReader(lines))
+
+
+def load_keys():
+    keys = []
+    for row in read_csv('creativision_keys.csv'):
+        group = row['group']
+        if group not in GROUPS:
+            raise KeymapError('unknown group "%s" for %s' % (group, row['name']))
+        side, keyboard, _ = GROUPS[group]
+        common = int(row['common'])
+        poles = [int(pin) for pin in row['poles'].split()]
+        if not 1 <= len(poles) <= 2:
+            raise KeymapError('%s must have 1 or 2 poles' % row['name'])
+        for pin in [common] + poles:
+            if pin not in PINS[side]:
+                raise KeymapError('%s: no pin %d on the controller' % (row['name'], pin))
+        if not PINS[side][common].startswith('PA'):
+            raise KeymapError('%s: common pin %d is not a PIA Port A pin'
+                              % (row['name'], common))
+        for pin in poles:
+            if not PINS[side][pin].startswith('PB'):
+                raise KeymapError('%s: pole pin %d is not a PIA Port B pin'
+                                  % (row['name'], pin))
+        keys.append({
+            'group': group, 'side': side, 'keyboard': keyboard,
+            'name': row['name'], 'label': row['label'],
+            'common': common, 'poles': poles,
+            'crosspoints': [PIA_ADDRESS[PINS[side][common]] | PIA_ADDRESS[PINS[side][pin]]
+                            for pin in poles],
+        })
+    return keys
+
+
+def load_ps2(keys):
+    keyboard = {key['name'] for key in keys if key['keyboard']}
+    codes = {}
+    entries = []
+    for row in read_csv('ps2_keymap.csv'):
+        parts = row['scancode'].split()
+        extended = len(parts) == 2 and parts[0].upper() == 'E0'
+        if len(parts) != (2 if extended else 1):
+            raise KeymapError('bad scancode "%s"' % row['scancode'])
+        code = int(parts[-1], 16)
+        if code >= 0x80:
+            raise KeymapError('scancode "%s" out of range' % row['scancode'])
+        if (extended, code) in codes:
+            raise KeymapError('scancode "%s" mapped to both %s and %s'
+                              % (row['scancode'], codes[(extended, code)], row['key']))
+        if row['key'] not in keyboard:
+            raise KeymapError('scancode "%s" maps to unknown key %s'
+                              % (row['scancode'], row['key']))
+        codes[(extended, code)] = row['key']
+        entries.append((extended, code, row['key'], row['description']))
+    return entries
+
+
+def validate(keys):
+    """Check no two keys share both poles, and report keyboard / joystick sharing.
+
+    Keyboard keys are only checked against other keyboard keys (and joystick
+    switches against joystick switches), as some keys are, by the console's
+    design, the very same switch as a joystick button (e.g. CNT'L = Left
+    Button 1). Those show up in the sharing report instead.
+    """
+    seen = {}
+    for key in keys:
+        poles = (key['keyboard'], frozenset(key['crosspoints']))
+        if poles in seen:
+            raise KeymapError('%s and %s share both poles' % (seen[poles], key['name']))
+        seen[poles] = key['name']
+
+    owners = {}
+    for key in keys:
+        for crosspoint in key['crosspoints']:
+            owners.setdefault(crosspoint, []).append(key)
+
+    report = []
+    for crosspoint in sorted(owners):
+        keyboard = [key['name'] for key in owners[crosspoint] if key['keyboard']]
+        joystick = [key['name'] for key in owners[crosspoint] if not key['keyboard']]
+        if keyboard and joystick:
+            report.append('crosspoint Y%d X%-2d: keyboard %s <-> joystick %s'
+                          % (crosspoint >> 4, crosspoint & 0x0F,
+                             ', '.join(keyboard), ', '.join(joystick)))
+    return report
+
+
+def emit_switches(keys):
+    out = []
+    group = None
+    for key in keys:
+        if key['group'] != group:
+            group = key['group']
+            out += ['/*', ' * ' + GROUPS[group][2], ' */', '']
+        side = key['side']
+        pins = ' + '.join('Pin %d' % pin for pin in key['poles'])
+        pia = ' + '.join('PIA_' + PINS[side][pin] for pin in key['poles'])
+        out.append('/* %s%s = Pin %d -> %s (PIA_%s -> %s) */'
+                   % ('Key ' if key['keyboard'] else '', key['label'],
+                      key['common'], pins, PINS[side][key['common']], pia))
+        common = 'PIA_' + PINS[side][key['common']]
+        if len(key['poles']) == 1:
+            out.append('#define Switch_%s (%s | PIA_%s)'
+                       % (key['name'], common, PINS[side][key['poles'][0]]))
+        else:
+            for suffix, pin in zip(('a', 'b'), key['poles']):
+                out.append('#define Switch_%s_%s (%s | PIA_%s)'
+                           % (key['name'], suffix, common, PINS[side][pin]))
+        out.append('')
+    return '\n'.join(out)
+
+
+def emit_ps2_keymap(keys, entries):
+    groups = {key['name']: key['group'] for key in keys if key['keyboard']}
+    out = ['static const uint8_t PS2_Keymap_Default[2][0x80] =', '{']
+    for extended in (False, True):
+        out.append('  {')
+        group = None
+        for ext, code, key, description in entries:
+            if ext == extended:
+                if groups[key] != group:
+                    if group is not None:
+                        out.append('')
+                    group = groups[key]
+                    out.append('    /* %s */' % GROUPS[group][2])
+                entry = '    [0x%02X] = ROUTE_KEY_%s,' % (code, key)
+                out.append('%-29s /* %s */' % (entry, description))
+        out.append('  },' if not extended else '  }')
+    out.append('};')
+    return '\n'.join(out)
+
+
+def replace_region(text, name, body):
+    begin = '/* BEGIN GENERATED %s (tools/keymap/keymap_gen.py) */\n' % name
+    end = '/* END GENERATED %s */' % name
+    start = text.index(begin) + len(begin)
+    stop = text.index(end, start)
+    return text[:start] + body + '\n' + text[stop:]
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--check', action='store_true',
+                        help='validate and report only, exit 1 if src/main.c is stale')
+    check = parser.parse_args().check
+    try:
+        keys = load_keys()
+        entries = load_ps2(keys)
+        report = validate(keys)
+    except (KeymapError, KeyError, ValueError) as error:
+        print('keymap error: %s' % error, file=sys.stderr)
+        return 1
+
+    print('%d switches, %d PS/2 codes' % (len(keys), len(entries)))
+    print('%d crosspoints shared between keyboard and joystick:' % len(report))
+    for line in report:
+        print('  ' + line)
+
+    with open(MAIN_C) as f:
+        text = f.read()
+    generated = replace_region(text, 'SWITCHES', emit_switches(keys))
+    generated = replace_region(generated, 'PS2_KEYMAP', emit_ps2_keymap(keys, entries))
+
+    if generated == text:
+        print('src/main.c is up to date')
+        return 0
+    if check:
+        print('src/main.c is out of date, please run keymap_gen.py', file=sys.stderr)
+        return 1
+    with open(MAIN_C, 'w') as f:
+        f.write(generated)
+    print('src/main.c updated')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())